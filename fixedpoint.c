@@ -3,7 +3,27 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+// The functions fixedpoint.h can define inline are defined only there;
+// the declarations below turn them into out-of-line definitions too.
+#ifndef FIXEDPOINT_INLINE
+#define FIXEDPOINT_INLINE 1
+#endif
 #include "fixedpoint.h"
+#include "fixedpoint_internal.h"
+
+extern inline uint64_t fixedpoint_whole_part(Fixedpoint val);
+extern inline uint64_t fixedpoint_frac_part(Fixedpoint val);
+extern inline Fixedpoint fixedpoint_negate(Fixedpoint val);
+extern inline int fixedpoint_compare(Fixedpoint left, Fixedpoint right);
+extern inline int fixedpoint_is_zero(Fixedpoint val);
+extern inline int fixedpoint_is_err(Fixedpoint val);
+extern inline int fixedpoint_is_neg(Fixedpoint val);
+extern inline int fixedpoint_is_overflow_neg(Fixedpoint val);
+extern inline int fixedpoint_is_overflow_pos(Fixedpoint val);
+extern inline int fixedpoint_is_underflow_neg(Fixedpoint val);
+extern inline int fixedpoint_is_underflow_pos(Fixedpoint val);
+extern inline int fixedpoint_is_div_by_zero(Fixedpoint val);
+extern inline int fixedpoint_is_valid(Fixedpoint val);
 
 Fixedpoint fixedpoint_create(uint64_t whole) {
   Fixedpoint val;
@@ -24,81 +44,126 @@ Fixedpoint fixedpoint_create2(uint64_t whole, uint64_t frac) {
 
 Fixedpoint fixedpoint_create_from_hex(const char *hex) {
   Fixedpoint val;
+  size_t len = strlen(hex);
 
-  if (!hex_is_valid(hex)) // error if parameter hex is not valid
-  {
-    val.tag = TAG_ERR;
-    return val;
+  // the whole string must be a value
+  if (fixedpoint_parse_hex(hex, len, &val) != len) {
+    val = fp_from_magnitude(0, TAG_ERR);
   }
-  
-  if (hex[0] == '-') // determine sign
-  {
-    val.tag = TAG_VALID_NEGATIVE;
-  } else {
-    val.tag = TAG_VALID_NONNEGATIVE;
+  return val;
+}
+
+// Value of each hex digit character, 0xff for all other characters
+#define XX 0xff
+static const uint8_t hex_digit_value[256] = {
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, XX, XX, XX, XX, XX, XX,
+  XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+
+// Store an error value for fixedpoint_parse_hex, returning the offset
+// of the offending byte
+static size_t parse_error(Fixedpoint *out, size_t offset) {
+  *out = fp_from_magnitude(0, TAG_ERR);
+  return offset;
+}
+
+size_t fixedpoint_parse_hex(const char *s, size_t len, Fixedpoint *out) {
+  const unsigned char *str = (const unsigned char *)s;
+  uint64_t whole = 0UL, frac = 0UL;
+  int neg = 0;
+  size_t i = 0, start;
+  uint8_t digit;
+
+  if (i < len && str[i] == '-') {
+    neg = 1;
+    i++;
   }
-  
-  const char *pos = strchr(hex, '.');  // search for '.' in hex
-  char *whole, *frac;
-  int len = strlen(hex);
-  int index;
-  if (pos)  // '.' found
-  {
-    index = pos - hex; // index of '.'
-    if (val.tag == TAG_VALID_NEGATIVE)
-    {
-      // copy whole and frac part into temporary char*
-      whole = (char *)calloc(index, sizeof(char));
-      frac = (char *)calloc(len - index, sizeof(char));
-      memcpy(whole, &hex[1], index - 1);
-      memcpy(frac, pos + 1, len - index);
-    } else {
-      // copy whole and frac part into temporary char*
-      whole = (char *)calloc(index + 1, sizeof(char));
-      frac = (char *)calloc(len - index, sizeof(char));
-      memcpy(whole, &hex[0], index);
-      memcpy(frac, pos + 1, len - index);
-    }
-  } else {
-    // '.' not found
-    if (val.tag == TAG_VALID_NEGATIVE)
-    {
-      whole = (char *)calloc(len, sizeof(char));
-      memcpy(whole, &hex[1], len - 1);
-    } else {
-      whole = (char *)calloc(len + 1, sizeof(char));
-      memcpy(whole, &hex[0], len + 1);
-    }
-      frac = (char *)calloc(2, sizeof(char)); // 1 more to contain '\0'
-      strcpy(frac, "0");
+
+  // whole part: shift in each digit
+  for (start = i; i < len && (digit = hex_digit_value[str[i]]) < 16; i++) {
+    if (i - start == 16) return parse_error(out, i);
+    whole = (whole << 4) | digit;
   }
-  
-  if (strlen(whole) > 16 || strlen(frac) > 16)
-  {
-    val.tag = TAG_ERR;
+
+  if (i < len && str[i] == '.') {
+    // fractional part: each digit goes 4 bits below the previous one
+    int shift = 60;
+    for (start = ++i; i < len && (digit = hex_digit_value[str[i]]) < 16; i++) {
+      if (i - start == 16) return parse_error(out, i);
+      frac |= (uint64_t)digit << shift;
+      shift -= 4;
+    }
+  } else if (i == start) {
+    // no digits and no '.'
+    return parse_error(out, i);
   }
-  
-  char *endptr;
-  // convert whole part into uint64_t
-  val.whole = strtoul(whole, &endptr, 16); 
-  // convert frac part into uint64_t. 
-  //We use variable literal here to make following shifts more convenient
-  uint64_t literal = strtoul(frac, &endptr, 16); 
-  int shifts = (16 - strlen(frac)) * 4;
-  val.frac = literal << shifts; 
-  free(whole);
-  free(frac);
-  return val;
+
+  // zero is never negative
+  *out = fixedpoint_create2(whole, frac);
+  if (neg && (whole | frac) != 0UL) out->tag = TAG_VALID_NEGATIVE;
+  return i;
 }
 
-uint64_t fixedpoint_whole_part(Fixedpoint val) {
-  return val.whole;
+#ifdef FIXEDPOINT_INT128
+// 128-bit two's-complement backend.
+//
+// A valid value is converted to two's complement before doing arithmetic.
+// Because the magnitude already uses all 128 bits, the signed value is
+// 129 bits wide: lo holds the low 128 bits and hi is the sign extension
+// word (0 or -1).  Sums of two such values land in hi = -2..1, which
+// directly encodes the result tag, so no branching on tags is needed.
+typedef struct {
+  fp_u128 lo;
+  int64_t hi;
+} TwosComplement;
+
+static inline TwosComplement to_twos_complement(Fixedpoint val) {
+  TwosComplement res;
+  fp_u128 mag = fp_magnitude(val);
+  int neg = (val.tag == TAG_VALID_NEGATIVE);
+  fp_u128 mask = -(fp_u128)neg;
+  res.lo = (mag ^ mask) - mask;
+  // a negative zero is just zero
+  res.hi = -(int64_t)(neg & (mag != 0));
+  return res;
 }
 
-uint64_t fixedpoint_frac_part(Fixedpoint val) {
-  return val.frac;
+// result tags indexed by hi + 2
+static const enum Tag sum_tags[4] = {TAG_NEG_OVERFLOW, TAG_VALID_NEGATIVE,
+                                     TAG_VALID_NONNEGATIVE, TAG_POS_OVERFLOW};
+
+Fixedpoint fixedpoint_add(Fixedpoint left, Fixedpoint right) {
+  TwosComplement l = to_twos_complement(left);
+  TwosComplement r = to_twos_complement(right);
+  fp_u128 lo;
+  int64_t carry = __builtin_add_overflow(l.lo, r.lo, &lo);
+  int64_t hi = l.hi + r.hi + carry;
+  // -2^128 fits in two's complement but its magnitude doesn't fit in 128 bits
+  hi -= (hi == -1) & (lo == 0);
+  // convert back to a magnitude (wrapped modulo 2^128 on overflow)
+  fp_u128 mask = -(fp_u128)(hi < 0);
+  return fp_from_magnitude((lo ^ mask) - mask, sum_tags[hi + 2]);
 }
 
+Fixedpoint fixedpoint_sub(Fixedpoint left, Fixedpoint right) {
+  return fixedpoint_add(left, fixedpoint_negate(right));
+}
+#else
 Fixedpoint fixedpoint_add(Fixedpoint left, Fixedpoint right) {
   Fixedpoint res;
   uint64_t whole_res;
@@ -150,6 +215,10 @@ Fixedpoint fixedpoint_add(Fixedpoint left, Fixedpoint right) {
     if (flag) res.tag = right.tag;
     else res.tag = left.tag;
   }
+  // a zero sum (e.g. equal magnitudes cancelling out) is non-negative
+  if (res.tag == TAG_VALID_NEGATIVE && whole_res == 0UL && frac_res == 0UL) {
+    res.tag = TAG_VALID_NONNEGATIVE;
+  }
   res.whole = whole_res;
   res.frac = frac_res;
   return res;
@@ -161,151 +230,328 @@ Fixedpoint fixedpoint_sub(Fixedpoint left, Fixedpoint right) {
   else if (right.tag == TAG_VALID_NONNEGATIVE) right.tag = TAG_VALID_NEGATIVE;
   return (fixedpoint_add(left, right));
 }
-
-Fixedpoint fixedpoint_negate(Fixedpoint val) {
-  if (val.tag == TAG_VALID_NONNEGATIVE) {
-    if (!(fixedpoint_is_zero(val))) val.tag = TAG_VALID_NEGATIVE;
+#endif // FIXEDPOINT_INT128
+
+Fixedpoint fixedpoint_mul(Fixedpoint left, Fixedpoint right) {
+  int neg = (left.tag == TAG_VALID_NEGATIVE) ^ (right.tag == TAG_VALID_NEGATIVE);
+  uint64_t p0, p1, p2, p3; // 256-bit product, least significant word first
+
+  if (left.frac == 0UL && right.frac == 0UL) {
+    // integer * integer: a single partial product, never underflows
+    fp_u128 hh = (fp_u128)left.whole * right.whole;
+    p0 = p1 = 0UL;
+    p2 = (uint64_t)hh;
+    p3 = (uint64_t)(hh >> 64);
+  } else if (left.whole == 0UL && right.whole == 0UL) {
+    // fraction * fraction: a single partial product, never overflows
+    fp_u128 ll = (fp_u128)left.frac * right.frac;
+    p0 = (uint64_t)ll;
+    p1 = (uint64_t)(ll >> 64);
+    p2 = p3 = 0UL;
+  } else {
+    // all four partial products (mulx/adx version if the CPU has them)
+    uint64_t p[4];
+    fp_kernels()->mul(left.whole, left.frac, right.whole, right.frac, p);
+    p0 = p[0];
+    p1 = p[1];
+    p2 = p[2];
+    p3 = p[3];
   }
-  else if (val.tag == TAG_VALID_NEGATIVE) val.tag = TAG_VALID_NONNEGATIVE;
-  return val;
-}
 
-Fixedpoint fixedpoint_halve(Fixedpoint val) {
-  Fixedpoint res;
-  uint64_t whole_res = val.whole/2;
-  uint64_t frac_res = val.frac;
-  // when fraction part is not divisible by 2, undeflow occurs
-  if (frac_res % 2 != 0) {
-    res.tag = (val.tag == TAG_VALID_NONNEGATIVE) ? TAG_POS_UNDERFLOW : TAG_NEG_UNDERFLOW;
+  // the Q64.64 result is the middle 128 bits of the product
+  Fixedpoint res = fixedpoint_create2(p2, p1);
+  if (p3 != 0UL) {
+    res.tag = neg ? TAG_NEG_OVERFLOW : TAG_POS_OVERFLOW;
+  } else if (p0 != 0UL) {
+    res.tag = neg ? TAG_NEG_UNDERFLOW : TAG_POS_UNDERFLOW;
+  } else if (neg && !fixedpoint_is_zero(res)) {
+    res.tag = TAG_VALID_NEGATIVE;
   }
-  else {
-    res.tag = val.tag;
-  }
-  frac_res = frac_res/2;
-  // if whole part is not divisible by 2, fraction part needs to be added 5 in decimal value
-  if (val.whole % 2 != 0) frac_res += 0x8000000000000000UL;
-  res.whole = whole_res;
-  res.frac = frac_res;
   return res;
 }
 
-Fixedpoint fixedpoint_double(Fixedpoint val) {
-  return fixedpoint_add(val, val);
+// Initial 11-bit reciprocal estimates floor((2^19 - 3*2^8) / d9), indexed by
+// d9 - 256 where d9 is the top 9 bits of a normalized divisor word
+static const uint16_t reciprocal_table[256] = {
+  0x7fd, 0x7f5, 0x7ed, 0x7e5, 0x7dd, 0x7d5, 0x7ce, 0x7c6,
+  0x7bf, 0x7b7, 0x7b0, 0x7a8, 0x7a1, 0x79a, 0x792, 0x78b,
+  0x784, 0x77d, 0x776, 0x76f, 0x768, 0x761, 0x75b, 0x754,
+  0x74d, 0x747, 0x740, 0x739, 0x733, 0x72c, 0x726, 0x720,
+  0x719, 0x713, 0x70d, 0x707, 0x700, 0x6fa, 0x6f4, 0x6ee,
+  0x6e8, 0x6e2, 0x6dc, 0x6d6, 0x6d1, 0x6cb, 0x6c5, 0x6bf,
+  0x6ba, 0x6b4, 0x6ae, 0x6a9, 0x6a3, 0x69e, 0x698, 0x693,
+  0x68d, 0x688, 0x683, 0x67d, 0x678, 0x673, 0x66e, 0x669,
+  0x664, 0x65e, 0x659, 0x654, 0x64f, 0x64a, 0x645, 0x640,
+  0x63c, 0x637, 0x632, 0x62d, 0x628, 0x624, 0x61f, 0x61a,
+  0x616, 0x611, 0x60c, 0x608, 0x603, 0x5ff, 0x5fa, 0x5f6,
+  0x5f1, 0x5ed, 0x5e9, 0x5e4, 0x5e0, 0x5dc, 0x5d7, 0x5d3,
+  0x5cf, 0x5cb, 0x5c6, 0x5c2, 0x5be, 0x5ba, 0x5b6, 0x5b2,
+  0x5ae, 0x5aa, 0x5a6, 0x5a2, 0x59e, 0x59a, 0x596, 0x592,
+  0x58e, 0x58a, 0x586, 0x583, 0x57f, 0x57b, 0x577, 0x574,
+  0x570, 0x56c, 0x568, 0x565, 0x561, 0x55e, 0x55a, 0x556,
+  0x553, 0x54f, 0x54c, 0x548, 0x545, 0x541, 0x53e, 0x53a,
+  0x537, 0x534, 0x530, 0x52d, 0x52a, 0x526, 0x523, 0x520,
+  0x51c, 0x519, 0x516, 0x513, 0x50f, 0x50c, 0x509, 0x506,
+  0x503, 0x500, 0x4fc, 0x4f9, 0x4f6, 0x4f3, 0x4f0, 0x4ed,
+  0x4ea, 0x4e7, 0x4e4, 0x4e1, 0x4de, 0x4db, 0x4d8, 0x4d5,
+  0x4d2, 0x4cf, 0x4cc, 0x4ca, 0x4c7, 0x4c4, 0x4c1, 0x4be,
+  0x4bb, 0x4b9, 0x4b6, 0x4b3, 0x4b0, 0x4ad, 0x4ab, 0x4a8,
+  0x4a5, 0x4a3, 0x4a0, 0x49d, 0x49b, 0x498, 0x495, 0x493,
+  0x490, 0x48d, 0x48b, 0x488, 0x486, 0x483, 0x481, 0x47e,
+  0x47c, 0x479, 0x477, 0x474, 0x472, 0x46f, 0x46d, 0x46a,
+  0x468, 0x465, 0x463, 0x461, 0x45e, 0x45c, 0x459, 0x457,
+  0x455, 0x452, 0x450, 0x44e, 0x44b, 0x449, 0x447, 0x444,
+  0x442, 0x440, 0x43e, 0x43b, 0x439, 0x437, 0x435, 0x432,
+  0x430, 0x42e, 0x42c, 0x42a, 0x428, 0x425, 0x423, 0x421,
+  0x41f, 0x41d, 0x41b, 0x419, 0x417, 0x414, 0x412, 0x410,
+  0x40e, 0x40c, 0x40a, 0x408, 0x406, 0x404, 0x402, 0x400
+};
+
+// Compute floor((2^128 - 1) / d) - 2^64 for a normalized d (top bit set).
+// The table estimate is refined by three Newton-Raphson steps, using only
+// multiplications (Moller & Granlund, "Improved division by invariant
+// integers", algorithm 2).
+static uint64_t reciprocal_word(uint64_t d) {
+  uint64_t d0 = d & 1UL;
+  uint64_t d40 = (d >> 24) + 1UL;
+  uint64_t d63 = (d >> 1) + d0;
+  uint64_t v0 = reciprocal_table[(d >> 55) - 256];
+  uint64_t v1 = (v0 << 11) - ((v0 * v0 * d40) >> 40) - 1UL;
+  uint64_t v2 = (v1 << 13) + ((v1 * ((1UL << 60) - v1 * d40)) >> 47);
+  uint64_t e = ((v2 >> 1) & -d0) - v2 * d63;
+  uint64_t v3 = (v2 << 31) + (uint64_t)(((fp_u128)v2 * e) >> 65);
+  fp_u128 p = (fp_u128)v3 * d + d + ((fp_u128)d << 64);
+  return v3 - (uint64_t)(p >> 64);
 }
 
-int fixedpoint_compare(Fixedpoint left, Fixedpoint right) {  
-  if (left.tag == right.tag)
-  {
-    if (left.tag == TAG_VALID_NONNEGATIVE) {
-      if (left.whole > right.whole) return 1;
-      if (left.whole < right.whole) return -1;
-      if (left.whole == right.whole)
-      {
-        if (left.frac > right.frac) return 1;
-        if (left.frac < right.frac) return -1;
-        return 0;
-      }
+// Extend the reciprocal of d1 to the reciprocal of the normalized two-word
+// divisor (d1, d0): floor((2^192 - 1) / (d1, d0)) - 2^64.
+static uint64_t reciprocal_3by2(uint64_t d1, uint64_t d0) {
+  uint64_t v = reciprocal_word(d1);
+  uint64_t p = d1 * v + d0;
+  if (p < d0) {
+    v--;
+    if (p >= d1) {
+      v--;
+      p -= d1;
     }
+    p -= d1;
+  }
+  fp_u128 t = (fp_u128)v * d0;
+  uint64_t t1 = (uint64_t)(t >> 64);
+  uint64_t t0 = (uint64_t)t;
+  p += t1;
+  if (p < t1) {
+    v--;
+    if (p > d1 || (p == d1 && t0 >= d0)) v--;
+  }
+  return v;
+}
 
-    if (left.tag == TAG_VALID_NEGATIVE) {
-      if (left.whole > right.whole) return -1;
-      if (left.whole < right.whole) return 1;
-      if (left.whole == right.whole)
-      {
-        if (left.frac > right.frac) return -1;
-        if (left.frac < right.frac) return 1;
-        return 0;
-      }
-    }
+// Divide the three-word value (n2, n1, n0) by the normalized divisor d
+// with precomputed reciprocal v.  Requires (n2, n1) < d.  Returns the
+// one-word quotient and stores the remainder in *rem.
+static uint64_t div_3by2(uint64_t n2, uint64_t n1, uint64_t n0, fp_u128 d,
+                         uint64_t v, fp_u128 *rem) {
+  uint64_t d1 = (uint64_t)(d >> 64);
+  uint64_t d0 = (uint64_t)d;
+  // candidate quotient from the reciprocal
+  fp_u128 q = (fp_u128)n2 * v + (((fp_u128)n2 << 64) | n1);
+  uint64_t q1 = (uint64_t)(q >> 64);
+  uint64_t q0 = (uint64_t)q;
+  // remainder of the candidate, modulo 2^128
+  fp_u128 r = ((fp_u128)(n1 - d1 * q1) << 64) | n0;
+  r -= d;
+  r -= (fp_u128)d0 * q1;
+  q1++;
+  // at most two adjustment steps
+  if ((uint64_t)(r >> 64) >= q0) {
+    q1--;
+    r += d;
+  }
+  if (r >= d) {
+    q1++;
+    r -= d;
+  }
+  *rem = r;
+  return q1;
+}
+
+// Compute the magnitude of the quotient num / den of two Q64.64 magnitudes,
+// i.e. floor(num * 2^64 / den).  Requires den != 0.
+//
+// Returns:
+//   0 if the quotient is exact,
+//   1 if the quotient was truncated (nonzero remainder),
+//   2 if the quotient doesn't fit in 128 bits (*quot is not set)
+static int divide_magnitudes(fp_u128 num, fp_u128 den, fp_u128 *quot) {
+  // num * 2^64 >= den * 2^128 exactly when the whole part of num >= den
+  if ((num >> 64) >= den) return 2;
+
+  // normalize so the divisor has its top bit set
+  int shift = (den >> 64) ? __builtin_clzl((uint64_t)(den >> 64))
+                          : 64 + __builtin_clzl((uint64_t)den);
+  fp_u128 d = den << shift;
+  uint64_t v = reciprocal_3by2((uint64_t)(d >> 64), (uint64_t)d);
+
+  // num << shift as three words; the overflow check guarantees it is
+  // smaller than d * 2^64
+  uint64_t n2, n1, n0;
+  if (shift == 0) {
+    n2 = 0UL;
+    n1 = (uint64_t)(num >> 64);
+    n0 = (uint64_t)num;
+  } else if (shift < 64) {
+    n2 = (uint64_t)(num >> (128 - shift));
+    n1 = (uint64_t)(num >> (64 - shift));
+    n0 = (uint64_t)num << shift;
   } else {
-    if (left.tag == TAG_VALID_NONNEGATIVE) return 1;
-    else return -1;
+    n2 = (uint64_t)((num << (shift - 64)) >> 64);
+    n1 = (uint64_t)(num << (shift - 64));
+    n0 = 0UL;
   }
 
-  return 0;
+  fp_u128 rem;
+  uint64_t q1 = div_3by2(n2, n1, n0, d, v, &rem);
+  uint64_t q0 = div_3by2((uint64_t)(rem >> 64), (uint64_t)rem, 0UL, d, v, &rem);
+  *quot = ((fp_u128)q1 << 64) | q0;
+  return rem != 0;
 }
 
-int fixedpoint_is_zero(Fixedpoint val) {
-  if ((val.whole == 0UL) && (val.frac == 0UL))
-  {
-    return 1;
+Fixedpoint fixedpoint_div(Fixedpoint left, Fixedpoint right) {
+  int neg = (left.tag == TAG_VALID_NEGATIVE) ^ (right.tag == TAG_VALID_NEGATIVE);
+  fp_u128 den = fp_magnitude(right);
+  fp_u128 quot = 0;
+
+  if (den == 0) {
+    return fp_from_magnitude(0, TAG_DIV_BY_ZERO);
   }
-  
-  return 0;
-}
 
-int fixedpoint_is_err(Fixedpoint val) {
-  if (val.tag == TAG_ERR)
-  {
-    return 1;
+  switch (divide_magnitudes(fp_magnitude(left), den, &quot)) {
+  case 2:
+    return fp_from_magnitude(0, neg ? TAG_NEG_OVERFLOW : TAG_POS_OVERFLOW);
+  case 1:
+    return fp_from_magnitude(quot, neg ? TAG_NEG_UNDERFLOW : TAG_POS_UNDERFLOW);
+  default:
+    return fp_from_magnitude(quot, (neg && quot != 0) ? TAG_VALID_NEGATIVE
+                                                      : TAG_VALID_NONNEGATIVE);
   }
-  return 0;
 }
 
-int fixedpoint_is_neg(Fixedpoint val) {
-  if (val.tag == TAG_VALID_NEGATIVE) return 1;
-  else return 0;
+Fixedpoint fixedpoint_scale_pow2(Fixedpoint val, int k) {
+  return fp_scale_pow2(val, k, FIXEDPOINT_ROUND_EXACT);
 }
 
-int fixedpoint_is_overflow_neg(Fixedpoint val) {
-  if (val.tag == TAG_NEG_OVERFLOW) return 1;
-  else return 0;
+Fixedpoint fixedpoint_scale_pow2_round(Fixedpoint val, int k, enum FixedpointRounding mode) {
+  return fp_scale_pow2(val, k, mode);
 }
 
-int fixedpoint_is_overflow_pos(Fixedpoint val) {
-  if (val.tag == TAG_POS_OVERFLOW) return 1;
-  else return 0;
+// The saturating operations always use the branch-free helpers, whatever
+// the backend
+static inline Fixedpoint addsub_sat(Fixedpoint left, Fixedpoint right, unsigned flip) {
+  uint64_t w, f;
+  uint8_t t;
+  fp_addsub_words(left.whole, left.frac, left.tag, right.whole, right.frac, right.tag, flip,
+                  &w, &f, &t);
+  fp_saturate_words(&w, &f, &t);
+  Fixedpoint res = fixedpoint_create2(w, f);
+  res.tag = (enum Tag)t;
+  return res;
 }
 
-int fixedpoint_is_underflow_neg(Fixedpoint val) {
-  if (val.tag == TAG_NEG_UNDERFLOW) return 1;
-  else return 0;
+Fixedpoint fixedpoint_add_sat(Fixedpoint left, Fixedpoint right) {
+  return addsub_sat(left, right, 0);
 }
 
-int fixedpoint_is_underflow_pos(Fixedpoint val) {
-  if (val.tag == TAG_POS_UNDERFLOW) return 1;
-  else return 0;
+Fixedpoint fixedpoint_sub_sat(Fixedpoint left, Fixedpoint right) {
+  return addsub_sat(left, right, 1);
 }
 
-int fixedpoint_is_valid(Fixedpoint val) {
-  if (val.tag == TAG_VALID_NONNEGATIVE || val.tag == TAG_VALID_NEGATIVE)
-  {
-    return 1;
+Fixedpoint fixedpoint_double_sat(Fixedpoint val) {
+  return addsub_sat(val, val, 0);
+}
+
+Fixedpoint fixedpoint_mul_sat(Fixedpoint left, Fixedpoint right) {
+  uint64_t p[4];
+  // no shortcuts for integer or fractional operands here: the full product
+  // takes the same path for all values
+  fp_kernels()->mul(left.whole, left.frac, right.whole, right.frac, p);
+  uint64_t m = -(uint64_t)(p[3] != 0UL);
+  Fixedpoint res = fixedpoint_create2(p[2] | m, p[1] | m);
+  // the sign of the product, unless it is (or was truncated to) zero
+  unsigned neg = (left.tag == TAG_VALID_NEGATIVE) ^ (right.tag == TAG_VALID_NEGATIVE);
+  res.tag = (enum Tag)(neg & ((res.whole | res.frac) != 0UL));
+  return res;
+}
+
+Fixedpoint fixedpoint_reciprocal(Fixedpoint val) {
+  return fixedpoint_div(fixedpoint_create(1UL), val);
+}
+
+Fixedpoint fixedpoint_halve(Fixedpoint val) {
+  Fixedpoint res;
+  uint64_t whole_res = val.whole/2;
+  uint64_t frac_res = val.frac;
+  // when fraction part is not divisible by 2, undeflow occurs
+  if (frac_res % 2 != 0) {
+    res.tag = (val.tag == TAG_VALID_NONNEGATIVE) ? TAG_POS_UNDERFLOW : TAG_NEG_UNDERFLOW;
   }
-  return 0;
+  else {
+    res.tag = val.tag;
+  }
+  frac_res = frac_res/2;
+  // if whole part is not divisible by 2, fraction part needs to be added 5 in decimal value
+  if (val.whole % 2 != 0) frac_res += 0x8000000000000000UL;
+  res.whole = whole_res;
+  res.frac = frac_res;
+  return res;
+}
+
+Fixedpoint fixedpoint_double(Fixedpoint val) {
+  return fixedpoint_add(val, val);
 }
 
 char *fixedpoint_format_as_hex(Fixedpoint val) {
-  char *hexstr, *whole, *frac;
+  char *hexstr = (char *)malloc(FIXEDPOINT_HEX_MAX_LEN + 1);
+  if (hexstr) fixedpoint_format_as_hex_into(val, hexstr, FIXEDPOINT_HEX_MAX_LEN + 1);
+  return hexstr;
+}
 
-  whole = (char *)calloc(17, sizeof(char));
-  sprintf(whole, "%llx", val.whole);
-  frac = (char *)calloc(17, sizeof(char));
-  sprintf(frac, "%llx", val.frac);
-  hexstr = (char *)calloc(35, sizeof(char));
+static const char hex_digits[16] = "0123456789abcdef";
 
-  if (val.tag == TAG_VALID_NEGATIVE)
-  {
-    strcat(hexstr, "-");
+size_t fixedpoint_format_as_hex_into(Fixedpoint val, char *buf, size_t size) {
+  char tmp[FIXEDPOINT_HEX_MAX_LEN + 1];
+  // format in place unless the buffer might be too small
+  char *out = (size > FIXEDPOINT_HEX_MAX_LEN) ? buf : tmp;
+  size_t len = 0;
+
+  if (val.tag == TAG_VALID_NEGATIVE) {
+    out[len++] = '-';
   }
 
-  strcat(hexstr, whole);
+  // whole part without leading zeros (but at least one digit)
+  int shift = (val.whole != 0UL) ? (63 - __builtin_clzl(val.whole)) / 4 * 4 : 0;
+  for (; shift >= 0; shift -= 4) {
+    out[len++] = hex_digits[(val.whole >> shift) & 0xf];
+  }
 
-  if (val.frac != 0x0UL)
-  {
-    strcat(hexstr, ".");
-    for (int i = 0; i < (int)(16-strlen(frac)); i++)
-    {
-      strcat(hexstr, "0");
+  // fractional part without trailing zeros, all 16 digits minus the
+  // trailing zero nibbles
+  if (val.frac != 0UL) {
+    int stop = __builtin_ctzl(val.frac) / 4 * 4;
+    out[len++] = '.';
+    for (shift = 60; shift >= stop; shift -= 4) {
+      out[len++] = hex_digits[(val.frac >> shift) & 0xf];
     }
-    strcat(hexstr, frac);
   }
+  out[len] = '\0';
 
-  remove_trailing_zeros(hexstr);
-
-  free(whole);
-  free(frac);
-  return hexstr;
+  if (out != buf && size > 0) {
+    size_t n = (len < size) ? len : size - 1;
+    memcpy(buf, tmp, n);
+    buf[n] = '\0';
+  }
+  return len;
 }
 
 int hex_is_valid(const char *hex) {
@@ -325,7 +571,13 @@ int hex_is_valid(const char *hex) {
     counter++;
   }
   
-  for (uint64_t i = counter + 1; i < strlen(hex); i++)
+  size_t len = strlen(hex);
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  for (uint64_t i = counter + 1; i < len; i++)
   {
     if (!(isxdigit(hex[i]) || (hex[i] == '.'))) // middle sequence can only have hex or '.'
     {
@@ -338,7 +590,7 @@ int hex_is_valid(const char *hex) {
     }
   }
 
-  if (!isxdigit(hex[strlen(hex)-1]) && hex[strlen(hex)-1] != '.') // if last digit is not hex digit
+  if (!isxdigit(hex[len-1]) && hex[len-1] != '.') // if last digit is not hex digit
   {
     return 0;
   }
@@ -4,7 +4,17 @@
 #include <stdint.h>
 
 enum Tag {TAG_VALID_NONNEGATIVE, TAG_VALID_NEGATIVE, TAG_ERR, TAG_POS_OVERFLOW,
-            TAG_NEG_OVERFLOW, TAG_POS_UNDERFLOW, TAG_NEG_UNDERFLOW};
+            TAG_NEG_OVERFLOW, TAG_POS_UNDERFLOW, TAG_NEG_UNDERFLOW,
+            TAG_DIV_BY_ZERO};
+
+// How fixedpoint_scale_pow2_round handles results that have nonzero bits
+// below 2^-64
+enum FixedpointRounding {
+  FIXEDPOINT_ROUND_EXACT,        // underflow: an underflow value (truncated)
+  FIXEDPOINT_ROUND_TRUNC,        // round toward zero
+  FIXEDPOINT_ROUND_FLOOR,        // round toward negative infinity
+  FIXEDPOINT_ROUND_NEAREST_EVEN  // round to nearest, ties to even
+};
 
 typedef struct {
   // TODO: add fields
@@ -13,6 +23,18 @@ typedef struct {
   enum Tag tag;
 } Fixedpoint;
 
+// If FIXEDPOINT_INLINE is defined (e.g. with -DFIXEDPOINT_INLINE), the
+// accessors, the predicates, fixedpoint_negate and fixedpoint_compare are
+// defined at the end of this header as inline functions, so that calls to
+// them can be inlined instead of copying their arguments to the stack.
+// fixedpoint.c always provides out-of-line definitions as well, so code
+// built with and without FIXEDPOINT_INLINE links against the same library.
+#ifdef FIXEDPOINT_INLINE
+#define FIXEDPOINT_INLINE_FN inline
+#else
+#define FIXEDPOINT_INLINE_FN
+#endif
+
 // Create a Fixedpoint value representing an integer.
 //
 // Parameters:
@@ -51,6 +73,26 @@ Fixedpoint fixedpoint_create2(uint64_t whole, uint64_t frac);
 //   fixedpoint_is_err returns true
 Fixedpoint fixedpoint_create_from_hex(const char *hex);
 
+// Parse a Fixedpoint value in the format accepted by
+// fixedpoint_create_from_hex from the beginning of a buffer of len
+// characters, which doesn't need to be NUL-terminated, without allocating
+// memory.  Parsing stops at the first character that can't continue the
+// value, so the value may be followed by other text (e.g. a newline).
+// "-0" and other negative zeros give a non-negative zero.
+//
+// Parameters:
+//   s - the characters to parse
+//   len - the number of characters available
+//   out - where the parsed value is stored; if the characters don't begin
+//         with a valid value, a value for which fixedpoint_is_err
+//         returns true is stored
+//
+// Returns:
+//   the number of characters consumed by the value, or if there was an
+//   error, the offset of the character that caused it (a 17th digit, or
+//   the first character if there are no digits and no '.')
+size_t fixedpoint_parse_hex(const char *s, size_t len, Fixedpoint *out);
+
 // Get the whole part of the given Fixedpoint value.
 //
 // Parameters:
@@ -58,7 +100,7 @@ Fixedpoint fixedpoint_create_from_hex(const char *hex);
 //
 // Returns:
 //   a uint64_t value which is the whole part of the Fixedpoint value
-uint64_t fixedpoint_whole_part(Fixedpoint val);
+FIXEDPOINT_INLINE_FN uint64_t fixedpoint_whole_part(Fixedpoint val);
 
 // Get the fractional part of the given Fixedpoint value.
 //
@@ -67,7 +109,7 @@ uint64_t fixedpoint_whole_part(Fixedpoint val);
 //
 // Returns:
 //   a uint64_t value which is the fractional part of the Fixedpoint value
-uint64_t fixedpoint_frac_part(Fixedpoint val);
+FIXEDPOINT_INLINE_FN uint64_t fixedpoint_frac_part(Fixedpoint val);
 
 // Compute the sum of two valid Fixedpoint values.
 //
@@ -99,6 +141,53 @@ Fixedpoint fixedpoint_add(Fixedpoint left, Fixedpoint right);
 //   the overflow was positive or negative)
 Fixedpoint fixedpoint_sub(Fixedpoint left, Fixedpoint right);
 
+// Compute the product of two valid Fixedpoint values.
+//
+// Parameters:
+//   left - the left Fixedpoint value
+//   right - the right Fixedpoint value
+//
+// Returns:
+//   if the product left * right can be represented exactly, the product
+//   is returned;
+//   if the magnitude of the product is too large to represent, then a value
+//   for which either fixedpoint_is_overflow_pos or fixedpoint_is_overflow_neg
+//   returns true is returned;
+//   otherwise, if the product has nonzero fraction bits below 2^-64, then a
+//   value for which either fixedpoint_is_underflow_pos or
+//   fixedpoint_is_underflow_neg returns true is returned (its whole and
+//   fractional parts hold the product truncated toward zero)
+Fixedpoint fixedpoint_mul(Fixedpoint left, Fixedpoint right);
+
+// Compute the quotient of two valid Fixedpoint values.
+//
+// Parameters:
+//   left - the dividend
+//   right - the divisor
+//
+// Returns:
+//   if right is zero, a value for which fixedpoint_is_div_by_zero returns true;
+//   if the magnitude of the quotient is too large to represent, a value for
+//   which either fixedpoint_is_overflow_pos or fixedpoint_is_overflow_neg
+//   returns true;
+//   if the quotient can't be represented exactly because the fractional part
+//   doesn't have enough bits, a value for which either
+//   fixedpoint_is_underflow_pos or fixedpoint_is_underflow_neg returns true
+//   (its whole and fractional parts hold the quotient truncated toward zero);
+//   otherwise, the exact quotient left / right
+Fixedpoint fixedpoint_div(Fixedpoint left, Fixedpoint right);
+
+// Compute the reciprocal 1 / val of a valid Fixedpoint value.
+// Overflow, underflow, and division by zero are reported as for
+// fixedpoint_div.
+//
+// Parameters:
+//   val - a valid Fixedpoint value
+//
+// Returns:
+//   the reciprocal of val
+Fixedpoint fixedpoint_reciprocal(Fixedpoint val);
+
 // Negate a valid Fixedpoint value.  (I.e. a value with the same magnitude but
 // the opposite sign is returned.)  As a special case, the zero value is considered
 // to be its own negation.
@@ -108,7 +197,7 @@ Fixedpoint fixedpoint_sub(Fixedpoint left, Fixedpoint right);
 //
 // Returns:
 //   the negation of val
-Fixedpoint fixedpoint_negate(Fixedpoint val);
+FIXEDPOINT_INLINE_FN Fixedpoint fixedpoint_negate(Fixedpoint val);
 
 // Return a Fixedpoint value that is exactly 1/2 the value of the given one.
 //
@@ -134,6 +223,89 @@ Fixedpoint fixedpoint_halve(Fixedpoint val);
 //   computed value would have been positive or negative)
 Fixedpoint fixedpoint_double(Fixedpoint val);
 
+// Multiply a valid Fixedpoint value by 2^k in a single step.  When the
+// result is valid, it is the same as that of k calls to fixedpoint_double
+// (if k > 0) or -k calls to fixedpoint_halve (if k < 0); otherwise it has
+// the overflow or underflow tag that the first failing call would have
+// produced, but not that call's whole and fractional parts (see below).
+//
+// Parameters:
+//   val - a valid Fixedpoint value
+//   k - the power of two (any int)
+//
+// Returns:
+//   val * 2^k, if it can be represented exactly;
+//   if its magnitude is too large to represent, a value for which either
+//   fixedpoint_is_overflow_pos or fixedpoint_is_overflow_neg returns true
+//   (its magnitude is wrapped modulo 2^128);
+//   if it has nonzero bits below 2^-64, a value for which either
+//   fixedpoint_is_underflow_pos or fixedpoint_is_underflow_neg returns true
+//   (its whole and fractional parts hold the result truncated toward zero)
+Fixedpoint fixedpoint_scale_pow2(Fixedpoint val, int k);
+
+// Multiply a valid Fixedpoint value by 2^k as fixedpoint_scale_pow2, but
+// round results that have nonzero bits below 2^-64 as specified.
+//
+// Parameters:
+//   val - a valid Fixedpoint value
+//   k - the power of two (any int)
+//   mode - the rounding mode; with FIXEDPOINT_ROUND_EXACT, the result is
+//          the same as that of fixedpoint_scale_pow2
+//
+// Returns:
+//   val * 2^k, rounded according to mode (a zero result is non-negative);
+//   if its magnitude is too large to represent, an overflow value as for
+//   fixedpoint_scale_pow2
+Fixedpoint fixedpoint_scale_pow2_round(Fixedpoint val, int k, enum FixedpointRounding mode);
+
+// Compute the saturating sum of two valid Fixedpoint values: like
+// fixedpoint_add, but if the sum is too large to represent, the valid value
+// with the largest magnitude and the sign of the sum is returned instead of
+// an overflow value.  There are no branches that depend on the values.
+//
+// Parameters:
+//   left - the left Fixedpoint value
+//   right - the right Fixedpoint value
+//
+// Returns:
+//   left + right, clamped to the range of representable values
+Fixedpoint fixedpoint_add_sat(Fixedpoint left, Fixedpoint right);
+
+// Compute the saturating difference of two valid Fixedpoint values, as for
+// fixedpoint_add_sat.
+//
+// Parameters:
+//   left - the left Fixedpoint value
+//   right - the right Fixedpoint value
+//
+// Returns:
+//   left - right, clamped to the range of representable values
+Fixedpoint fixedpoint_sub_sat(Fixedpoint left, Fixedpoint right);
+
+// Return twice a valid Fixedpoint value, saturating as fixedpoint_add_sat.
+//
+// Parameters:
+//   val - a valid Fixedpoint value
+//
+// Returns:
+//   val * 2, clamped to the range of representable values
+Fixedpoint fixedpoint_double_sat(Fixedpoint val);
+
+// Compute the saturating product of two valid Fixedpoint values: if the
+// magnitude of the product is too large to represent, the valid value with
+// the largest magnitude and the sign of the product is returned; if it
+// has nonzero bits below 2^-64, it is truncated toward zero to the nearest
+// representable value (a zero result is non-negative).  The result is
+// always valid, and there are no branches that depend on the values.
+//
+// Parameters:
+//   left - the left Fixedpoint value
+//   right - the right Fixedpoint value
+//
+// Returns:
+//   left * right, clamped to the range of representable values
+Fixedpoint fixedpoint_mul_sat(Fixedpoint left, Fixedpoint right);
+
 // Compare two valid Fixedpoint values.
 //
 // Parameters:
@@ -144,7 +316,7 @@ Fixedpoint fixedpoint_double(Fixedpoint val);
 //    -1 if left < right;
 //     0 if left == right;
 //     1 if left > right
-int fixedpoint_compare(Fixedpoint left, Fixedpoint right);
+FIXEDPOINT_INLINE_FN int fixedpoint_compare(Fixedpoint left, Fixedpoint right);
 
 // Determine whether a Fixedpoint value is equal to 0.
 //
@@ -154,7 +326,7 @@ int fixedpoint_compare(Fixedpoint left, Fixedpoint right);
 // Returns:
 //   1 if val is a valid Fixedpoint value equal to 0;
 //   0 is val is not a valid Fixedpoint value equal to 0
-int fixedpoint_is_zero(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_zero(Fixedpoint val);
 
 // Determine whether a Fixedpoint value is an "error" value resulting
 // from a call to fixedpoint_create_from_hex for which the argument
@@ -167,7 +339,7 @@ int fixedpoint_is_zero(Fixedpoint val);
 //   1 if val is the result of a call to fixedpoint_create_from_hex with
 //   an invalid argument string;
 //   0 otherwise
-int fixedpoint_is_err(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_err(Fixedpoint val);
 
 // Determine whether a Fixedpoint value is negative (less than 0).
 //
@@ -178,7 +350,7 @@ int fixedpoint_is_err(Fixedpoint val);
 // Returns:
 //   1 if val is a valid value less than 0;
 //   0 otherwise
-int fixedpoint_is_neg(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_neg(Fixedpoint val);
 
 // Determine whether a Fixedpoint value is the result of negative overflow.
 // Negative overflow results when a sum, difference, or product is negative
@@ -190,7 +362,7 @@ int fixedpoint_is_neg(Fixedpoint val);
 // Returns:
 //   1 if val is the result of an operation where negative overflow occurred;
 //   0 otherwise
-int fixedpoint_is_overflow_neg(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_overflow_neg(Fixedpoint val);
 
 // Determine whether a Fixedpoint value is the result of positive overflow.
 // Positive overflow results when a sum, difference, or product is positive
@@ -202,12 +374,13 @@ int fixedpoint_is_overflow_neg(Fixedpoint val);
 // Returns:
 //   1 if val is the result of an operation where positive overflow occurred;
 //   0 otherwise
-int fixedpoint_is_overflow_pos(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_overflow_pos(Fixedpoint val);
 
 // Determine whether a Fixedpoint value is the result of negative underflow.
-// Negative underflow occurs when a division (i.e., fixedpoint_halve)
-// produces a value that is negative, and can't be exactly represented because
-// the fractional part of the representation doesn't have enough bits.
+// Negative underflow occurs when an operation such as fixedpoint_halve,
+// fixedpoint_mul, fixedpoint_div, or fixedpoint_scale_pow2 produces a
+// value that is negative, and can't be exactly represented because the
+// fractional part of the representation doesn't have enough bits.
 //
 // Parameters:
 //   val - the Fixedpoint value
@@ -215,12 +388,13 @@ int fixedpoint_is_overflow_pos(Fixedpoint val);
 // Returns:
 //   1 if val is the result of an operation where negative underflow occurred;
 //   0 otherwise
-int fixedpoint_is_underflow_neg(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_underflow_neg(Fixedpoint val);
 
 // Determine whether a Fixedpoint value is the result of positive underflow.
-// Positive underflow occurs when a division (i.e., fixedpoint_halve)
-// produces a value that is positive, and can't be exactly represented because
-// the fractional part of the representation doesn't have enough bits.
+// Positive underflow occurs when an operation such as fixedpoint_halve,
+// fixedpoint_mul, fixedpoint_div, or fixedpoint_scale_pow2 produces a
+// value that is positive, and can't be exactly represented because the
+// fractional part of the representation doesn't have enough bits.
 //
 // Parameters:
 //   val - the Fixedpoint value
@@ -228,7 +402,18 @@ int fixedpoint_is_underflow_neg(Fixedpoint val);
 // Returns:
 //   1 if val is the result of an operation where positive underflow occurred;
 //   0 otherwise
-int fixedpoint_is_underflow_pos(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_underflow_pos(Fixedpoint val);
+
+// Determine whether a Fixedpoint value is the result of a division by zero
+// (fixedpoint_div or fixedpoint_reciprocal with a zero divisor).
+//
+// Parameters:
+//   val - the Fixedpoint value
+//
+// Returns:
+//   1 if val is the result of a division by zero;
+//   0 otherwise
+FIXEDPOINT_INLINE_FN int fixedpoint_is_div_by_zero(Fixedpoint val);
 
 // Determine whether a Fixedpoint value represents a valid negative or non-negative number.
 //
@@ -238,7 +423,7 @@ int fixedpoint_is_underflow_pos(Fixedpoint val);
 // Returns:
 //   1 if val represents a valid negative or non-negative number;
 //   0 otherwise
-int fixedpoint_is_valid(Fixedpoint val);
+FIXEDPOINT_INLINE_FN int fixedpoint_is_valid(Fixedpoint val);
 
 // Return a dynamically allocated C character string with the representation of
 // the given valid Fixedpoint value.  The string should start with "-" if the
@@ -255,6 +440,26 @@ int fixedpoint_is_valid(Fixedpoint val);
 //   of the Fixedpoint value
 char *fixedpoint_format_as_hex(Fixedpoint val);
 
+// Maximum length of the representation of a Fixedpoint value, not counting
+// the NUL terminator: sign, 16 whole digits, '.', 16 fractional digits
+#define FIXEDPOINT_HEX_MAX_LEN 34
+
+// Write the representation of the given valid Fixedpoint value (the same
+// string fixedpoint_format_as_hex returns) into a caller-supplied buffer,
+// without allocating memory.  Like snprintf, at most size bytes are
+// written, including the NUL terminator, so a buffer of
+// FIXEDPOINT_HEX_MAX_LEN + 1 bytes is always large enough.
+//
+// Parameters:
+//   val - the Fixedpoint value
+//   buf - the buffer (may be NULL if size is 0)
+//   size - the size of the buffer in bytes
+//
+// Returns:
+//   the length of the full representation (not counting the NUL
+//   terminator); if it is >= size, the output was truncated
+size_t fixedpoint_format_as_hex_into(Fixedpoint val, char *buf, size_t size);
+
 // Helper function
 // Determine whether the argument char * in fixedpoint_create_from_hex are hex
 // digits
@@ -273,4 +478,82 @@ int hex_is_valid(const char *hex);
 // Parameters:
 //   str - the string
 void remove_trailing_zeros(char *str);
+
+#ifdef FIXEDPOINT_INLINE
+FIXEDPOINT_INLINE_FN uint64_t fixedpoint_whole_part(Fixedpoint val) {
+  return val.whole;
+}
+
+FIXEDPOINT_INLINE_FN uint64_t fixedpoint_frac_part(Fixedpoint val) {
+  return val.frac;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_zero(Fixedpoint val) {
+  return (val.whole | val.frac) == 0UL;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_err(Fixedpoint val) {
+  return val.tag == TAG_ERR;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_neg(Fixedpoint val) {
+  return val.tag == TAG_VALID_NEGATIVE;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_overflow_neg(Fixedpoint val) {
+  return val.tag == TAG_NEG_OVERFLOW;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_overflow_pos(Fixedpoint val) {
+  return val.tag == TAG_POS_OVERFLOW;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_underflow_neg(Fixedpoint val) {
+  return val.tag == TAG_NEG_UNDERFLOW;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_underflow_pos(Fixedpoint val) {
+  return val.tag == TAG_POS_UNDERFLOW;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_div_by_zero(Fixedpoint val) {
+  return val.tag == TAG_DIV_BY_ZERO;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_is_valid(Fixedpoint val) {
+  return val.tag == TAG_VALID_NONNEGATIVE || val.tag == TAG_VALID_NEGATIVE;
+}
+
+FIXEDPOINT_INLINE_FN Fixedpoint fixedpoint_negate(Fixedpoint val) {
+  // the two valid tags differ only in the low bit; zero and
+  // non-valid values are left alone
+  int flip = (val.tag <= TAG_VALID_NEGATIVE) & ((val.whole | val.frac) != 0UL);
+  val.tag = (enum Tag)(val.tag ^ flip);
+  return val;
+}
+
+FIXEDPOINT_INLINE_FN int fixedpoint_compare(Fixedpoint left, Fixedpoint right) {
+#ifdef FIXEDPOINT_INT128
+  // compare the 129-bit two's complement forms without branching: the
+  // sign words (all ones for a negative value; zero counts as non-negative
+  // whatever its tag says), then the whole words, then the fractional words
+  uint64_t ln = -(uint64_t)((left.tag == TAG_VALID_NEGATIVE) & ((left.whole | left.frac) != 0UL));
+  uint64_t rn = -(uint64_t)((right.tag == TAG_VALID_NEGATIVE) & ((right.whole | right.frac) != 0UL));
+  uint64_t lw = (left.whole ^ ln) + (ln & (left.frac == 0UL)), lf = (left.frac ^ ln) - ln;
+  uint64_t rw = (right.whole ^ rn) + (rn & (right.frac == 0UL)), rf = (right.frac ^ rn) - rn;
+  int gt = (ln < rn) | ((ln == rn) & ((lw > rw) | ((lw == rw) & (lf > rf))));
+  int lt = (ln > rn) | ((ln == rn) & ((lw < rw) | ((lw == rw) & (lf < rf))));
+  return gt - lt;
+#else
+  // zero is neither negative nor positive, whatever its tag says
+  int left_neg = (left.tag == TAG_VALID_NEGATIVE) & ((left.whole | left.frac) != 0UL);
+  int right_neg = (right.tag == TAG_VALID_NEGATIVE) & ((right.whole | right.frac) != 0UL);
+  if (left_neg != right_neg) return right_neg - left_neg;
+  // same sign: compare the magnitudes, reversed if both are negative
+  int cmp = (left.whole > right.whole) - (left.whole < right.whole);
+  if (cmp == 0) cmp = (left.frac > right.frac) - (left.frac < right.frac);
+  return left_neg ? -cmp : cmp;
+#endif
+}
+#endif // FIXEDPOINT_INLINE
 #endif // FIXEDPREC_H
@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fixedpoint_array.h"
+#include "fixedpoint_internal.h"
+
+// Number of elements the *_sat and *_status operations process at a time,
+// so that the results are still in the L1 cache for the second pass over
+// them
+#define STATUS_BLOCK 1024
+
+// aligned_alloc requires the size to be a multiple of the alignment
+void *fp_alloc_column(size_t n, size_t elem_size) {
+  if (n > (SIZE_MAX - FIXEDPOINT_ARRAY_ALIGN) / elem_size) return NULL;
+  size_t bytes = n * elem_size;
+  bytes = (bytes + FIXEDPOINT_ARRAY_ALIGN - 1) / FIXEDPOINT_ARRAY_ALIGN * FIXEDPOINT_ARRAY_ALIGN;
+  if (bytes == 0) bytes = FIXEDPOINT_ARRAY_ALIGN;
+  void *col = aligned_alloc(FIXEDPOINT_ARRAY_ALIGN, bytes);
+  if (col) memset(col, 0, bytes);
+  return col;
+}
+
+FixedpointArray *fixedpoint_array_create(size_t len) {
+  FixedpointArray *arr = malloc(sizeof(FixedpointArray));
+  if (!arr) return NULL;
+
+  arr->whole = fp_alloc_column(len, sizeof(uint64_t));
+  arr->frac = fp_alloc_column(len, sizeof(uint64_t));
+  arr->tag = fp_alloc_column(len, sizeof(uint8_t)); // TAG_VALID_NONNEGATIVE is 0
+  arr->len = len;
+  if (!arr->whole || !arr->frac || !arr->tag) {
+    fixedpoint_array_destroy(arr);
+    return NULL;
+  }
+  return arr;
+}
+
+void fixedpoint_array_destroy(FixedpointArray *arr) {
+  if (!arr) return;
+  free(arr->whole);
+  free(arr->frac);
+  free(arr->tag);
+  free(arr);
+}
+
+Fixedpoint fixedpoint_array_get(const FixedpointArray *arr, size_t i) {
+  Fixedpoint val;
+  val.whole = arr->whole[i];
+  val.frac = arr->frac[i];
+  val.tag = (enum Tag)arr->tag[i];
+  return val;
+}
+
+void fixedpoint_array_set(FixedpointArray *arr, size_t i, Fixedpoint val) {
+  arr->whole[i] = val.whole;
+  arr->frac[i] = val.frac;
+  arr->tag[i] = (uint8_t)val.tag;
+}
+
+void fixedpoint_array_load(FixedpointArray *arr, size_t start, const Fixedpoint *src, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    fixedpoint_array_set(arr, start + i, src[i]);
+  }
+}
+
+void fixedpoint_array_store(const FixedpointArray *arr, size_t start, Fixedpoint *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    dst[i] = fixedpoint_array_get(arr, start + i);
+  }
+}
+
+// The kernels for the instruction set level selected at runtime live in
+// fixedpoint_simd.c; they take the column pointers offset by start.
+
+// add and sub only differ in whether the right operand's sign is flipped
+static void addsub(FixedpointArray *dst, const FixedpointArray *left,
+                   const FixedpointArray *right, size_t start, size_t n, unsigned flip) {
+  fp_kernels()->addsub(dst->whole + start, dst->frac + start, dst->tag + start,
+                       left->whole + start, left->frac + start, left->tag + start,
+                       right->whole + start, right->frac + start, right->tag + start, n, flip);
+}
+
+void fixedpoint_array_add(FixedpointArray *dst, const FixedpointArray *left,
+                          const FixedpointArray *right, size_t start, size_t n) {
+  addsub(dst, left, right, start, n, 0);
+}
+
+void fixedpoint_array_sub(FixedpointArray *dst, const FixedpointArray *left,
+                          const FixedpointArray *right, size_t start, size_t n) {
+  addsub(dst, left, right, start, n, 1);
+}
+
+void fixedpoint_array_negate(FixedpointArray *dst, const FixedpointArray *src,
+                             size_t start, size_t n) {
+  fp_kernels()->negate(dst->whole + start, dst->frac + start, dst->tag + start,
+                       src->whole + start, src->frac + start, src->tag + start, n);
+}
+
+void fixedpoint_array_halve(FixedpointArray *dst, const FixedpointArray *src,
+                            size_t start, size_t n) {
+  fp_kernels()->halve(dst->whole + start, dst->frac + start, dst->tag + start,
+                      src->whole + start, src->frac + start, src->tag + start, n);
+}
+
+void fixedpoint_array_double(FixedpointArray *dst, const FixedpointArray *src,
+                             size_t start, size_t n) {
+  addsub(dst, src, src, start, n, 0);
+}
+
+void fixedpoint_array_scale_pow2(FixedpointArray *dst, const FixedpointArray *src,
+                                 size_t start, size_t n, int k, enum FixedpointRounding mode) {
+  for (size_t i = start; i < start + n; i++) {
+    fixedpoint_array_set(dst, i, fp_scale_pow2(fixedpoint_array_get(src, i), k, mode));
+  }
+}
+
+void fixedpoint_array_compare(int8_t *out, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n) {
+  fp_kernels()->compare(out, left->whole + start, left->frac + start, left->tag + start,
+                        right->whole + start, right->frac + start, right->tag + start, n);
+}
+
+// Saturate the results of an add/sub kernel for elements start .. start+n-1
+static void saturate(FixedpointArray *dst, size_t start, size_t n) {
+  uint64_t *w = dst->whole + start, *f = dst->frac + start;
+  uint8_t *t = dst->tag + start;
+  for (size_t i = 0; i < n; i++) {
+    fp_saturate_words(&w[i], &f[i], &t[i]);
+  }
+}
+
+static void addsub_sat(FixedpointArray *dst, const FixedpointArray *left,
+                       const FixedpointArray *right, size_t start, size_t n, unsigned flip) {
+  for (size_t s = start; s < start + n; s += STATUS_BLOCK) {
+    size_t m = (start + n - s < STATUS_BLOCK) ? start + n - s : STATUS_BLOCK;
+    addsub(dst, left, right, s, m, flip);
+    saturate(dst, s, m);
+  }
+}
+
+void fixedpoint_array_add_sat(FixedpointArray *dst, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n) {
+  addsub_sat(dst, left, right, start, n, 0);
+}
+
+void fixedpoint_array_sub_sat(FixedpointArray *dst, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n) {
+  addsub_sat(dst, left, right, start, n, 1);
+}
+
+void fixedpoint_array_double_sat(FixedpointArray *dst, const FixedpointArray *src,
+                                 size_t start, size_t n) {
+  addsub_sat(dst, src, src, start, n, 0);
+}
+
+void fixedpoint_array_mul_sat(FixedpointArray *dst, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n) {
+  for (size_t i = start; i < start + n; i++) {
+    fixedpoint_array_set(dst, i, fixedpoint_mul_sat(fixedpoint_array_get(left, i),
+                                                    fixedpoint_array_get(right, i)));
+  }
+}
+
+static _Thread_local FixedpointStatus thread_status = { 0, FIXEDPOINT_NO_INDEX };
+
+void fixedpoint_status_clear(FixedpointStatus *status) {
+  status->flags = 0;
+  status->first_index = FIXEDPOINT_NO_INDEX;
+}
+
+FixedpointStatus *fixedpoint_status(void) {
+  return &thread_status;
+}
+
+// The valid tag with the sign of each tag (TAG_ERR and TAG_DIV_BY_ZERO
+// can't be produced by the operations with a status)
+static const uint8_t valid_tags[8] = {
+  TAG_VALID_NONNEGATIVE, TAG_VALID_NEGATIVE, TAG_ERR, TAG_VALID_NONNEGATIVE,
+  TAG_VALID_NEGATIVE, TAG_VALID_NONNEGATIVE, TAG_VALID_NEGATIVE, TAG_DIV_BY_ZERO
+};
+
+// Collect the flags of the result tags of elements start .. start+n-1,
+// replacing the tags by valid ones.  The first pass only ors the tags
+// together (without branches), which is enough to tell that all results
+// are valid; only if some aren't are the flags and the index of the
+// first offending element worked out.
+static void collect_status(FixedpointArray *dst, size_t start, size_t n, FixedpointStatus *status) {
+  uint8_t *tag = dst->tag + start;
+  uint8_t other = 0;
+  for (size_t i = 0; i < n; i++) {
+    other |= tag[i] & ~TAG_VALID_NEGATIVE;
+  }
+  if (!other) return;
+
+  if (status->first_index == FIXEDPOINT_NO_INDEX) {
+    size_t i = 0;
+    while (tag[i] <= TAG_VALID_NEGATIVE) i++;
+    status->first_index = start + i;
+  }
+  unsigned flags = 0;
+  for (size_t i = 0; i < n; i++) {
+    flags |= 1U << tag[i];
+    tag[i] = valid_tags[tag[i] & 7];
+  }
+  status->flags |= flags & ~((1U << TAG_VALID_NONNEGATIVE) | (1U << TAG_VALID_NEGATIVE));
+}
+
+static void addsub_status(FixedpointArray *dst, const FixedpointArray *left,
+                          const FixedpointArray *right, size_t start, size_t n, unsigned flip,
+                          FixedpointStatus *status) {
+  if (!status) status = &thread_status;
+  for (size_t s = start; s < start + n; s += STATUS_BLOCK) {
+    size_t m = (start + n - s < STATUS_BLOCK) ? start + n - s : STATUS_BLOCK;
+    addsub(dst, left, right, s, m, flip);
+    collect_status(dst, s, m, status);
+  }
+}
+
+void fixedpoint_array_add_status(FixedpointArray *dst, const FixedpointArray *left,
+                                 const FixedpointArray *right, size_t start, size_t n,
+                                 FixedpointStatus *status) {
+  addsub_status(dst, left, right, start, n, 0, status);
+}
+
+void fixedpoint_array_sub_status(FixedpointArray *dst, const FixedpointArray *left,
+                                 const FixedpointArray *right, size_t start, size_t n,
+                                 FixedpointStatus *status) {
+  addsub_status(dst, left, right, start, n, 1, status);
+}
+
+void fixedpoint_array_halve_status(FixedpointArray *dst, const FixedpointArray *src,
+                                   size_t start, size_t n, FixedpointStatus *status) {
+  if (!status) status = &thread_status;
+  for (size_t s = start; s < start + n; s += STATUS_BLOCK) {
+    size_t m = (start + n - s < STATUS_BLOCK) ? start + n - s : STATUS_BLOCK;
+    fixedpoint_array_halve(dst, src, s, m);
+    collect_status(dst, s, m, status);
+  }
+}
+
+void fixedpoint_array_double_status(FixedpointArray *dst, const FixedpointArray *src,
+                                    size_t start, size_t n, FixedpointStatus *status) {
+  addsub_status(dst, src, src, start, n, 0, status);
+}
@@ -0,0 +1,194 @@
+#ifndef FIXEDPOINT_ARRAY_H
+#define FIXEDPOINT_ARRAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fixedpoint.h"
+
+// Alignment (in bytes) of each column of a FixedpointArray
+#define FIXEDPOINT_ARRAY_ALIGN 64
+
+// An array of Fixedpoint values stored as separate columns
+// (structure-of-arrays): 17 bytes per element instead of the 24 bytes
+// of a Fixedpoint, and loops over a range touch contiguous memory only.
+//
+// The batch operations below compute exactly what the corresponding
+// scalar function would for each element, but without branches, so that
+// the compiler can vectorize them.  Each operates on the elements
+// start .. start+n-1 of its arguments.  The destination may be the same
+// array as a source, but must not otherwise share memory with one.
+typedef struct {
+  uint64_t *whole; // whole parts
+  uint64_t *frac;  // fractional parts
+  uint8_t *tag;    // tags (enum Tag values)
+  size_t len;      // number of elements
+} FixedpointArray;
+
+// Create an array of len elements, all equal to zero.
+//
+// Parameters:
+//   len - the number of elements
+//
+// Returns:
+//   pointer to the new array, or NULL if memory couldn't be allocated
+FixedpointArray *fixedpoint_array_create(size_t len);
+
+// Free an array created by fixedpoint_array_create.
+//
+// Parameters:
+//   arr - the array (may be NULL)
+void fixedpoint_array_destroy(FixedpointArray *arr);
+
+// Get element i of an array.
+//
+// Parameters:
+//   arr - the array
+//   i - the index of the element
+//
+// Returns:
+//   the element as a Fixedpoint value
+Fixedpoint fixedpoint_array_get(const FixedpointArray *arr, size_t i);
+
+// Set element i of an array.
+//
+// Parameters:
+//   arr - the array
+//   i - the index of the element
+//   val - the new value of the element
+void fixedpoint_array_set(FixedpointArray *arr, size_t i, Fixedpoint val);
+
+// Copy n Fixedpoint values into the array, starting at element start.
+//
+// Parameters:
+//   arr - the destination array
+//   start - index of the first element to set
+//   src - the values to copy
+//   n - the number of values
+void fixedpoint_array_load(FixedpointArray *arr, size_t start, const Fixedpoint *src, size_t n);
+
+// Copy n elements of the array, starting at element start, into an
+// array of Fixedpoint values.
+//
+// Parameters:
+//   arr - the source array
+//   start - index of the first element to copy
+//   dst - the destination for the values
+//   n - the number of values
+void fixedpoint_array_store(const FixedpointArray *arr, size_t start, Fixedpoint *dst, size_t n);
+
+// Element-wise fixedpoint_add of valid values: dst = left + right.
+void fixedpoint_array_add(FixedpointArray *dst, const FixedpointArray *left,
+                          const FixedpointArray *right, size_t start, size_t n);
+
+// Element-wise fixedpoint_sub of valid values: dst = left - right.
+void fixedpoint_array_sub(FixedpointArray *dst, const FixedpointArray *left,
+                          const FixedpointArray *right, size_t start, size_t n);
+
+// Element-wise fixedpoint_negate: dst = -src.
+void fixedpoint_array_negate(FixedpointArray *dst, const FixedpointArray *src,
+                             size_t start, size_t n);
+
+// Element-wise fixedpoint_halve of valid values: dst = src / 2.
+void fixedpoint_array_halve(FixedpointArray *dst, const FixedpointArray *src,
+                            size_t start, size_t n);
+
+// Element-wise fixedpoint_double of valid values: dst = src * 2.
+void fixedpoint_array_double(FixedpointArray *dst, const FixedpointArray *src,
+                             size_t start, size_t n);
+
+// Element-wise fixedpoint_scale_pow2_round of valid values:
+// dst = src * 2^k, rounded according to mode.
+void fixedpoint_array_scale_pow2(FixedpointArray *dst, const FixedpointArray *src,
+                                 size_t start, size_t n, int k, enum FixedpointRounding mode);
+
+// Element-wise fixedpoint_compare of valid values.  The result for element
+// start+i is stored in out[i] (-1, 0, or 1).
+void fixedpoint_array_compare(int8_t *out, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n);
+
+// Element-wise fixedpoint_add_sat of valid values: dst = left + right,
+// clamped to the range of representable values.
+void fixedpoint_array_add_sat(FixedpointArray *dst, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n);
+
+// Element-wise fixedpoint_sub_sat of valid values: dst = left - right,
+// clamped to the range of representable values.
+void fixedpoint_array_sub_sat(FixedpointArray *dst, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n);
+
+// Element-wise fixedpoint_double_sat of valid values: dst = src * 2,
+// clamped to the range of representable values.
+void fixedpoint_array_double_sat(FixedpointArray *dst, const FixedpointArray *src,
+                                 size_t start, size_t n);
+
+// Element-wise fixedpoint_mul_sat of valid values: dst = left * right,
+// clamped to the range of representable values.
+void fixedpoint_array_mul_sat(FixedpointArray *dst, const FixedpointArray *left,
+                              const FixedpointArray *right, size_t start, size_t n);
+
+// Status flags of the batch operations below: one bit per kind of
+// non-valid result (the bit for a tag t is 1 << t)
+#define FIXEDPOINT_FLAG_POS_OVERFLOW  (1U << TAG_POS_OVERFLOW)
+#define FIXEDPOINT_FLAG_NEG_OVERFLOW  (1U << TAG_NEG_OVERFLOW)
+#define FIXEDPOINT_FLAG_POS_UNDERFLOW (1U << TAG_POS_UNDERFLOW)
+#define FIXEDPOINT_FLAG_NEG_UNDERFLOW (1U << TAG_NEG_UNDERFLOW)
+#define FIXEDPOINT_FLAG_OVERFLOW  (FIXEDPOINT_FLAG_POS_OVERFLOW | FIXEDPOINT_FLAG_NEG_OVERFLOW)
+#define FIXEDPOINT_FLAG_UNDERFLOW (FIXEDPOINT_FLAG_POS_UNDERFLOW | FIXEDPOINT_FLAG_NEG_UNDERFLOW)
+
+// first_index of a status in which no flag has been raised
+#define FIXEDPOINT_NO_INDEX ((size_t)-1)
+
+// Sticky status of a sequence of batch operations, in the style of the
+// IEEE floating point exception flags.  The *_status variants of the
+// batch operations never store overflow or underflow tags: every result
+// gets a valid tag with its sign, and holds the magnitude wrapped modulo
+// 2^128 (on overflow) or truncated toward zero (on underflow), exactly
+// as the tagged result would.  Instead, the condition is or'ed into the
+// status flags, so that a whole batch (or pipeline of batches) can be
+// checked once.
+typedef struct {
+  unsigned flags;     // FIXEDPOINT_FLAG_* bits raised since the last clear
+  size_t first_index; // index of the first element that raised a flag,
+                      // or FIXEDPOINT_NO_INDEX
+} FixedpointStatus;
+
+// Clear a status: no flags raised.
+//
+// Parameters:
+//   status - the status to clear
+void fixedpoint_status_clear(FixedpointStatus *status);
+
+// Get the calling thread's default status, used by the *_status
+// operations when they are passed a NULL status.  It starts out clear.
+//
+// Returns:
+//   pointer to the calling thread's status
+FixedpointStatus *fixedpoint_status(void);
+
+// Element-wise fixedpoint_add of valid values, raising status flags
+// instead of storing non-valid results: dst = left + right.
+//
+// Parameters:
+//   dst, left, right, start, n - as for fixedpoint_array_add
+//   status - the status to update, or NULL for the thread's default status
+void fixedpoint_array_add_status(FixedpointArray *dst, const FixedpointArray *left,
+                                 const FixedpointArray *right, size_t start, size_t n,
+                                 FixedpointStatus *status);
+
+// Element-wise fixedpoint_sub of valid values, raising status flags
+// instead of storing non-valid results: dst = left - right.
+void fixedpoint_array_sub_status(FixedpointArray *dst, const FixedpointArray *left,
+                                 const FixedpointArray *right, size_t start, size_t n,
+                                 FixedpointStatus *status);
+
+// Element-wise fixedpoint_halve of valid values, raising status flags
+// instead of storing non-valid results: dst = src / 2.
+void fixedpoint_array_halve_status(FixedpointArray *dst, const FixedpointArray *src,
+                                   size_t start, size_t n, FixedpointStatus *status);
+
+// Element-wise fixedpoint_double of valid values, raising status flags
+// instead of storing non-valid results: dst = src * 2.
+void fixedpoint_array_double_status(FixedpointArray *dst, const FixedpointArray *src,
+                                    size_t start, size_t n, FixedpointStatus *status);
+
+#endif // FIXEDPOINT_ARRAY_H
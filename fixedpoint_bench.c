@@ -0,0 +1,784 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "fixedpoint.h"
+#include "fixedpoint_dispatch.h"
+#include "fixedpoint_internal.h"
+#include "fixedpoint_sum.h"
+
+// Number of operand pairs used by each benchmark
+#define NUM_OPERANDS 4096
+
+// xorshift64 pseudo-random generator, so runs are reproducible
+static uint64_t rng_state = 0x9e3779b97f4a7c15UL;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// Random value whose whole and fractional parts have a random bit length,
+// so that operands span many orders of magnitude
+static Fixedpoint random_value(void) {
+  uint64_t whole = rng_next() >> (rng_next() % 64);
+  uint64_t frac = rng_next() << (rng_next() % 64);
+  Fixedpoint val = fixedpoint_create2(whole, frac);
+  if (rng_next() & 1) val = fixedpoint_negate(val);
+  return val;
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Reference division: restoring long division of left * 2^64 by right,
+// producing one quotient bit per step.  Same result tags as fixedpoint_div.
+static Fixedpoint div_bitserial(Fixedpoint left, Fixedpoint right) {
+  int neg = fixedpoint_is_neg(left) ^ fixedpoint_is_neg(right);
+  fp_u128 num = fp_magnitude(left);
+  fp_u128 den = fp_magnitude(right);
+  fp_u128 rem = 0, quot = 0;
+  int overflow = 0;
+
+  if (den == 0) {
+    return fp_from_magnitude(0, TAG_DIV_BY_ZERO);
+  }
+
+  // the dividend num * 2^64 has 192 bits
+  for (int i = 191; i >= 0; i--) {
+    int bit = (i >= 64) ? (int)((num >> (i - 64)) & 1) : 0;
+    int top = (int)(rem >> 127);
+    rem = (rem << 1) | (fp_u128)bit;
+    if (top || rem >= den) {
+      rem -= den;
+      if (i >= 128) overflow = 1;
+      else quot |= (fp_u128)1 << i;
+    }
+  }
+
+  if (overflow) {
+    return fp_from_magnitude(0, neg ? TAG_NEG_OVERFLOW : TAG_POS_OVERFLOW);
+  }
+  if (rem != 0) {
+    return fp_from_magnitude(quot, neg ? TAG_NEG_UNDERFLOW : TAG_POS_UNDERFLOW);
+  }
+  return fp_from_magnitude(quot, (neg && quot != 0) ? TAG_VALID_NEGATIVE
+                                                    : TAG_VALID_NONNEGATIVE);
+}
+
+static int same_result(Fixedpoint a, Fixedpoint b) {
+  return a.tag == b.tag && a.whole == b.whole && a.frac == b.frac;
+}
+
+// Operands, generated once.  Each benchmark reads operand pairs
+// BATCH at a time, so the samples are the average time per operation
+// over a batch.
+#define BATCH 256
+
+// Fixedpoint operands: non-negative, negative, and with random signs
+static Fixedpoint pos[2][NUM_OPERANDS], neg[2][NUM_OPERANDS], mixed[2][NUM_OPERANDS];
+// the mixed operands as hex strings (with their lengths), doubles, and
+// 128-bit two's complement Q64.64 integers
+static char hex[NUM_OPERANDS][FIXEDPOINT_HEX_MAX_LEN + 1];
+static size_t hex_len[NUM_OPERANDS];
+static uint64_t whole_in[NUM_OPERANDS], frac_in[NUM_OPERANDS];
+static double dbl[2][NUM_OPERANDS];
+static fp_i128 i128[2][NUM_OPERANDS];
+
+static void init_operands(void) {
+  for (int k = 0; k < 2; k++) {
+    for (int i = 0; i < NUM_OPERANDS; i++) {
+      pos[k][i] = random_value();
+      if (fixedpoint_is_neg(pos[k][i])) pos[k][i] = fixedpoint_negate(pos[k][i]);
+      neg[k][i] = fixedpoint_negate(random_value());
+      if (!fixedpoint_is_neg(neg[k][i])) neg[k][i] = fixedpoint_negate(neg[k][i]);
+      mixed[k][i] = random_value();
+
+      fp_i128 mag = (fp_i128)(fp_magnitude(mixed[k][i]) >> 1); // keep sums in range
+      i128[k][i] = fixedpoint_is_neg(mixed[k][i]) ? -mag : mag;
+      dbl[k][i] = (double)i128[k][i] / 18446744073709551616.0;
+    }
+  }
+  for (int i = 0; i < NUM_OPERANDS; i++) {
+    hex_len[i] = fixedpoint_format_as_hex_into(mixed[0][i], hex[i], sizeof(hex[i]));
+    whole_in[i] = mixed[0][i].whole;
+    frac_in[i] = mixed[0][i].frac;
+  }
+}
+
+// Fold a result into a checksum, so the compiler can't discard it
+static inline uint64_t fold(Fixedpoint val) {
+  return val.whole ^ val.frac ^ val.tag;
+}
+
+// Operations that need temporaries
+static inline uint64_t parse_hex(int i) {
+  Fixedpoint val;
+  return fixedpoint_parse_hex(hex[i], hex_len[i], &val) + fold(val);
+}
+
+static inline uint64_t format_as_hex(int i) {
+  char *str = fixedpoint_format_as_hex(mixed[0][i]);
+  uint64_t c = (uint8_t)str[0];
+  free(str);
+  return c;
+}
+
+static inline uint64_t format_as_hex_into(int i) {
+  char buf[FIXEDPOINT_HEX_MAX_LEN + 1];
+  return fixedpoint_format_as_hex_into(mixed[0][i], buf, sizeof(buf)) + (uint8_t)buf[0];
+}
+
+// a running sum: each addition depends on the previous one
+static FixedpointAccumulator acc;
+
+static inline uint64_t accumulate(int i) {
+  fixedpoint_accumulator_add(&acc, mixed[0][i]);
+  return acc.word[0];
+}
+
+static FixedpointLazySum lazy_sum;
+
+static inline uint64_t lazy_accumulate(int i) {
+  fixedpoint_lazy_sum_add(&lazy_sum, mixed[0][i]);
+  return lazy_sum.frac;
+}
+
+static inline uint64_t format_double(int i) {
+  char buf[32];
+  return snprintf(buf, sizeof(buf), "%a", dbl[0][i]) + (uint8_t)buf[0];
+}
+
+// A benchmark runs BATCH operations on the operands base .. base+BATCH-1,
+// returning a checksum of the results
+typedef uint64_t (*BenchFn)(int base);
+
+#define DEFINE_BENCH(name, expr) \
+  static uint64_t name(int base) { \
+    uint64_t sink = 0; \
+    for (int i = base; i < base + BATCH; i++) { \
+      sink += (uint64_t)(expr); \
+    } \
+    return sink; \
+  }
+
+DEFINE_BENCH(b_create, fold(fixedpoint_create(whole_in[i])))
+DEFINE_BENCH(b_create2, fold(fixedpoint_create2(whole_in[i], frac_in[i])))
+DEFINE_BENCH(b_create_from_hex, fold(fixedpoint_create_from_hex(hex[i])))
+DEFINE_BENCH(b_parse_hex, parse_hex(i))
+DEFINE_BENCH(b_whole_frac_part, fixedpoint_whole_part(mixed[0][i]) ^ fixedpoint_frac_part(mixed[0][i]))
+DEFINE_BENCH(b_add_pp, fold(fixedpoint_add(pos[0][i], pos[1][i])))
+DEFINE_BENCH(b_add_pn, fold(fixedpoint_add(pos[0][i], neg[1][i])))
+DEFINE_BENCH(b_add_np, fold(fixedpoint_add(neg[0][i], pos[1][i])))
+DEFINE_BENCH(b_add_nn, fold(fixedpoint_add(neg[0][i], neg[1][i])))
+DEFINE_BENCH(b_sub_pp, fold(fixedpoint_sub(pos[0][i], pos[1][i])))
+DEFINE_BENCH(b_sub_pn, fold(fixedpoint_sub(pos[0][i], neg[1][i])))
+DEFINE_BENCH(b_sub_np, fold(fixedpoint_sub(neg[0][i], pos[1][i])))
+DEFINE_BENCH(b_sub_nn, fold(fixedpoint_sub(neg[0][i], neg[1][i])))
+DEFINE_BENCH(b_mul, fold(fixedpoint_mul(mixed[0][i], mixed[1][i])))
+DEFINE_BENCH(b_add_sat, fold(fixedpoint_add_sat(mixed[0][i], mixed[1][i])))
+DEFINE_BENCH(b_mul_sat, fold(fixedpoint_mul_sat(mixed[0][i], mixed[1][i])))
+DEFINE_BENCH(b_div, fold(fixedpoint_div(mixed[0][i], mixed[1][i])))
+DEFINE_BENCH(b_div_bitserial, fold(div_bitserial(mixed[0][i], mixed[1][i])))
+DEFINE_BENCH(b_reciprocal, fold(fixedpoint_reciprocal(mixed[0][i])))
+DEFINE_BENCH(b_negate, fold(fixedpoint_negate(mixed[0][i])))
+DEFINE_BENCH(b_halve, fold(fixedpoint_halve(mixed[0][i])))
+DEFINE_BENCH(b_double, fold(fixedpoint_double(mixed[0][i])))
+DEFINE_BENCH(b_scale_pow2, fold(fixedpoint_scale_pow2_round(mixed[0][i], (i & 63) - 32,
+                                                            FIXEDPOINT_ROUND_NEAREST_EVEN)))
+DEFINE_BENCH(b_accumulate, accumulate(i))
+DEFINE_BENCH(b_lazy_accumulate, lazy_accumulate(i))
+DEFINE_BENCH(b_compare, fixedpoint_compare(mixed[0][i], mixed[1][i]))
+DEFINE_BENCH(b_predicates,
+             fixedpoint_is_zero(mixed[0][i]) + fixedpoint_is_err(mixed[0][i])
+             + fixedpoint_is_neg(mixed[0][i]) + fixedpoint_is_overflow_neg(mixed[0][i])
+             + fixedpoint_is_overflow_pos(mixed[0][i]) + fixedpoint_is_underflow_neg(mixed[0][i])
+             + fixedpoint_is_underflow_pos(mixed[0][i]) + fixedpoint_is_div_by_zero(mixed[0][i])
+             + fixedpoint_is_valid(mixed[0][i]))
+DEFINE_BENCH(b_format_as_hex, format_as_hex(i))
+DEFINE_BENCH(b_format_as_hex_into, format_as_hex_into(i))
+
+// Baselines: the same operations on double and on 128-bit two's
+// complement Q64.64 integers
+DEFINE_BENCH(b_dbl_add, dbl[0][i] + dbl[1][i])
+DEFINE_BENCH(b_dbl_mul, dbl[0][i] * dbl[1][i])
+DEFINE_BENCH(b_dbl_div, dbl[0][i] / dbl[1][i])
+DEFINE_BENCH(b_dbl_compare, (dbl[0][i] > dbl[1][i]) - (dbl[0][i] < dbl[1][i]))
+DEFINE_BENCH(b_dbl_format, format_double(i))
+DEFINE_BENCH(b_i128_add, (uint64_t)(i128[0][i] + i128[1][i]))
+DEFINE_BENCH(b_i128_sub, (uint64_t)(i128[0][i] - i128[1][i]))
+DEFINE_BENCH(b_i128_mul, (uint64_t)(i128[0][i] * i128[1][i]))
+DEFINE_BENCH(b_i128_compare, (i128[0][i] > i128[1][i]) - (i128[0][i] < i128[1][i]))
+
+// A benchmark: the operation, the class of its inputs, and the function
+// running it
+typedef struct {
+  const char *op;
+  const char *input;
+  BenchFn fn;
+} Bench;
+
+static const Bench benches[] = {
+  { "create", "random", b_create },
+  { "create2", "random", b_create2 },
+  { "create_from_hex", "hex", b_create_from_hex },
+  { "parse_hex", "hex", b_parse_hex },
+  { "whole_part+frac_part", "random", b_whole_frac_part },
+  { "add", "pos+pos", b_add_pp },
+  { "add", "pos+neg", b_add_pn },
+  { "add", "neg+pos", b_add_np },
+  { "add", "neg+neg", b_add_nn },
+  { "sub", "pos-pos", b_sub_pp },
+  { "sub", "pos-neg", b_sub_pn },
+  { "sub", "neg-pos", b_sub_np },
+  { "sub", "neg-neg", b_sub_nn },
+  { "mul", "random", b_mul },
+  { "add_sat", "random", b_add_sat },
+  { "mul_sat", "random", b_mul_sat },
+  { "div", "random", b_div },
+  { "reciprocal", "random", b_reciprocal },
+  { "negate", "random", b_negate },
+  { "halve", "random", b_halve },
+  { "double", "random", b_double },
+  { "scale_pow2_round", "random, k=-32..31", b_scale_pow2 },
+  { "accumulator_add", "random", b_accumulate },
+  { "lazy_sum_add", "random", b_lazy_accumulate },
+  { "compare", "random", b_compare },
+  { "is_* (all 9)", "random", b_predicates },
+  { "format_as_hex", "random", b_format_as_hex },
+  { "format_as_hex_into", "random", b_format_as_hex_into },
+  { "baseline bit-serial div", "random", b_div_bitserial },
+  { "baseline double add", "random", b_dbl_add },
+  { "baseline double mul", "random", b_dbl_mul },
+  { "baseline double div", "random", b_dbl_div },
+  { "baseline double compare", "random", b_dbl_compare },
+  { "baseline double snprintf %a", "random", b_dbl_format },
+  { "baseline __int128 add", "random", b_i128_add },
+  { "baseline __int128 sub", "random", b_i128_sub },
+  { "baseline __int128 mul", "random", b_i128_mul },
+  { "baseline __int128 compare", "random", b_i128_compare },
+};
+
+#define NUM_BENCHES ((int)(sizeof(benches) / sizeof(benches[0])))
+
+// Number of hardware performance counters (see open_counters)
+#define NUM_COUNTERS 5
+
+// Upper limit on the number of runs of each benchmark
+#define MAX_RUNS 100
+
+// Statistics of one benchmark
+typedef struct {
+  int num_runs;
+  double run_ns[MAX_RUNS];   // mean ns/op of each run
+  double mean, stddev;       // over the runs
+  double p50, p90, p99;      // of the per-batch ns/op, over all runs
+  double counters[NUM_COUNTERS]; // hardware events per op, or -1 if unavailable
+} Result;
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Percentile p (0..100) of n sorted samples
+static double percentile(const double *sorted, int n, double p) {
+  int i = (int)(p / 100.0 * (n - 1) + 0.5);
+  return sorted[i];
+}
+
+// Mean and sample standard deviation of n values
+static void mean_stddev(const double *x, int n, double *mean, double *stddev) {
+  double sum = 0.0, sq = 0.0;
+  for (int i = 0; i < n; i++) sum += x[i];
+  *mean = sum / n;
+  for (int i = 0; i < n; i++) sq += (x[i] - *mean) * (x[i] - *mean);
+  *stddev = (n > 1) ? sqrt(sq / (n - 1)) : 0.0;
+}
+
+// Hardware performance counters, read with perf_event_open (Linux only).
+// Each counter is opened separately, so that the ones the CPU (or a
+// virtual machine) doesn't provide can be skipped.  If more are opened
+// than the PMU can count at once, the kernel time-multiplexes them, and
+// the counts are scaled by the fraction of time each one was running.
+enum { CTR_CYCLES, CTR_INSTRUCTIONS, CTR_BRANCHES, CTR_BRANCH_MISSES, CTR_L1D_MISSES };
+
+static const char *const counter_names[NUM_COUNTERS] = {
+  "cycles", "instructions", "branches", "branch_misses", "l1d_misses"
+};
+
+// File descriptors of the open counters, -1 if unavailable
+static int counter_fd[NUM_COUNTERS] = { -1, -1, -1, -1, -1 };
+
+#if defined(__linux__)
+static int open_counter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+// Open the counters, returning how many are available
+static int open_counters(void) {
+  int n = 0;
+#if defined(__linux__)
+  counter_fd[CTR_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  counter_fd[CTR_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  counter_fd[CTR_BRANCHES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+  counter_fd[CTR_BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  counter_fd[CTR_L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE,
+                                            PERF_COUNT_HW_CACHE_L1D
+                                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+  for (int i = 0; i < NUM_COUNTERS; i++) n += counter_fd[i] >= 0;
+  return n;
+}
+
+static void close_counters(void) {
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    if (counter_fd[i] >= 0) close(counter_fd[i]);
+    counter_fd[i] = -1;
+  }
+}
+
+static void start_counters(void) {
+#if defined(__linux__)
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    if (counter_fd[i] < 0) continue;
+    ioctl(counter_fd[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+// Stop the counters and store their values divided by ops (-1 for
+// unavailable counters)
+static void stop_counters(double ops, double *per_op) {
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    per_op[i] = -1.0;
+#if defined(__linux__)
+    uint64_t buf[3]; // value, time enabled, time running
+    if (counter_fd[i] < 0) continue;
+    ioctl(counter_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    if (read(counter_fd[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) continue;
+    per_op[i] = (double)buf[0] * ((double)buf[1] / buf[2]) / ops;
+#endif
+  }
+  (void)ops;
+}
+
+static uint64_t bench_sink;
+
+// Run a benchmark runs times, each time for rounds passes over the
+// operands (after one warm-up pass)
+static void run_bench(const Bench *b, int runs, int rounds, Result *res) {
+  int batches = NUM_OPERANDS / BATCH;
+  int n = runs * rounds * batches;
+  double *samples = malloc(n * sizeof(double));
+
+  for (int base = 0; base < NUM_OPERANDS; base += BATCH) {
+    bench_sink += b->fn(base);
+  }
+  for (int run = 0, k = 0; run < runs; run++) {
+    double total = 0.0;
+    for (int r = 0; r < rounds; r++) {
+      for (int base = 0; base < NUM_OPERANDS; base += BATCH) {
+        double start = now_ns();
+        bench_sink += b->fn(base);
+        double elapsed = now_ns() - start;
+        samples[k++] = elapsed / BATCH;
+        total += elapsed;
+      }
+    }
+    res->run_ns[run] = total / ((double)rounds * NUM_OPERANDS);
+  }
+  res->num_runs = runs;
+  mean_stddev(res->run_ns, runs, &res->mean, &res->stddev);
+
+  // the counters are read in a separate pass, without the timing calls
+  start_counters();
+  for (int r = 0; r < rounds; r++) {
+    for (int base = 0; base < NUM_OPERANDS; base += BATCH) {
+      bench_sink += b->fn(base);
+    }
+  }
+  stop_counters((double)rounds * NUM_OPERANDS, res->counters);
+
+  qsort(samples, n, sizeof(double), compare_doubles);
+  res->p50 = percentile(samples, n, 50);
+  res->p90 = percentile(samples, n, 90);
+  res->p99 = percentile(samples, n, 99);
+  free(samples);
+}
+
+// Print a value, or "-" if it is negative (unavailable)
+static void print_value(FILE *out, int width, double x) {
+  if (x < 0.0) fprintf(out, " %*s", width, "-");
+  else fprintf(out, " %*.2f", width, x);
+}
+
+// Print the hardware counters per op and the ratios derived from them
+static void print_counters(FILE *out, const Result *results, const int *selected) {
+  fprintf(out, "\n%-36s %9s %9s %6s %9s %9s %8s %9s\n", "benchmark", "cycles", "instrs",
+          "IPC", "branches", "br-miss", "miss %", "L1d-miss");
+  for (int i = 0; i < NUM_BENCHES; i++) {
+    if (!selected[i]) continue;
+    const double *c = results[i].counters;
+    char name[128];
+    snprintf(name, sizeof(name), "%s (%s)", benches[i].op, benches[i].input);
+    fprintf(out, "%-36s", name);
+    print_value(out, 9, c[CTR_CYCLES]);
+    print_value(out, 9, c[CTR_INSTRUCTIONS]);
+    print_value(out, 6, (c[CTR_CYCLES] > 0.0 && c[CTR_INSTRUCTIONS] >= 0.0)
+                        ? c[CTR_INSTRUCTIONS] / c[CTR_CYCLES] : -1.0);
+    print_value(out, 9, c[CTR_BRANCHES]);
+    print_value(out, 9, c[CTR_BRANCH_MISSES]);
+    print_value(out, 8, (c[CTR_BRANCHES] > 0.0 && c[CTR_BRANCH_MISSES] >= 0.0)
+                        ? 100.0 * c[CTR_BRANCH_MISSES] / c[CTR_BRANCHES] : -1.0);
+    print_value(out, 9, c[CTR_L1D_MISSES]);
+    fprintf(out, "\n");
+  }
+}
+
+// Name of the CPU, from /proc/cpuinfo
+static void cpu_model(char *buf, size_t size) {
+  char line[256];
+  FILE *f = fopen("/proc/cpuinfo", "r");
+
+  snprintf(buf, size, "unknown");
+  if (!f) return;
+  while (fgets(line, sizeof(line), f)) {
+    char *colon = strchr(line, ':');
+    if (strncmp(line, "model name", 10) == 0 && colon) {
+      snprintf(buf, size, "%s", colon + 2);
+      buf[strcspn(buf, "\n")] = '\0';
+      break;
+    }
+  }
+  fclose(f);
+}
+
+// Write a string as a JSON string literal
+static void json_string(FILE *out, const char *str) {
+  fputc('"', out);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') fprintf(out, "\\%c", *str);
+    else if ((unsigned char)*str < 0x20) fprintf(out, "\\u%04x", *str);
+    else fputc(*str, out);
+  }
+  fputc('"', out);
+}
+
+// The compiler the benchmark was built with (clang defines __GNUC__ and
+// __VERSION__ too, so it's checked first)
+#if defined(__clang__)
+#define COMPILER "clang " __clang_version__
+#elif defined(__GNUC__)
+#define COMPILER "gcc " __VERSION__
+#else
+#define COMPILER "unknown"
+#endif
+
+// Write the results as JSON.  Each result is on a line of its own, which
+// is what read_baseline relies on.
+static void write_json(FILE *out, const Result *results, const int *selected, int rounds) {
+  char cpu[128];
+  cpu_model(cpu, sizeof(cpu));
+
+  fprintf(out, "{\n  \"cpu\": ");
+  json_string(out, cpu);
+  fprintf(out, ",\n  \"compiler\": ");
+  json_string(out, COMPILER);
+  fprintf(out, ",\n  \"cflags\": ");
+  json_string(out, BENCH_CFLAGS);
+  fprintf(out, ",\n  \"isa\": ");
+  json_string(out, fixedpoint_isa_name(fixedpoint_isa()));
+  fprintf(out, ",\n  \"operands\": %d,\n  \"rounds\": %d,\n  \"results\": [\n", NUM_OPERANDS, rounds);
+
+  int first = 1;
+  for (int i = 0; i < NUM_BENCHES; i++) {
+    if (!selected[i]) continue;
+    const Result *r = &results[i];
+    fprintf(out, "%s    {\"op\": ", first ? "" : ",\n");
+    json_string(out, benches[i].op);
+    fprintf(out, ", \"input\": ");
+    json_string(out, benches[i].input);
+    fprintf(out, ", \"ns_per_op\": %.4f, \"stddev\": %.4f, \"ops_per_s\": %.0f, "
+            "\"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"runs\": [",
+            r->mean, r->stddev, 1e9 / r->mean, r->p50, r->p90, r->p99);
+    for (int k = 0; k < r->num_runs; k++) {
+      fprintf(out, "%s%.4f", k ? ", " : "", r->run_ns[k]);
+    }
+    fprintf(out, "]");
+    for (int k = 0; k < NUM_COUNTERS; k++) {
+      if (r->counters[k] >= 0.0) fprintf(out, ", \"%s\": %.4f", counter_names[k], r->counters[k]);
+    }
+    fprintf(out, "}");
+    first = 0;
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+// Get the string value of "key": "..." in a line of JSON written by
+// write_json (which never escapes anything in benchmark names)
+static int json_get_string(const char *line, const char *key, char *buf, size_t size) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\": \"", key);
+  const char *start = strstr(line, pattern);
+  if (!start) return 0;
+  start += strlen(pattern);
+  const char *end = strchr(start, '"');
+  if (!end || (size_t)(end - start) >= size) return 0;
+  memcpy(buf, start, end - start);
+  buf[end - start] = '\0';
+  return 1;
+}
+
+// Read the per-run times of the benchmarks from a JSON file written by
+// write_json into baseline[]; benchmarks not in the file get 0 runs.
+static int read_baseline(const char *path, Result *baseline) {
+  char line[4096], op[64], input[64];
+  FILE *f = fopen(path, "r");
+  if (!f) return -1;
+
+  for (int i = 0; i < NUM_BENCHES; i++) baseline[i].num_runs = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (!json_get_string(line, "op", op, sizeof(op))
+        || !json_get_string(line, "input", input, sizeof(input))) {
+      continue;
+    }
+    const char *runs = strstr(line, "\"runs\": [");
+    if (!runs) continue;
+    for (int i = 0; i < NUM_BENCHES; i++) {
+      if (strcmp(op, benches[i].op) != 0 || strcmp(input, benches[i].input) != 0) continue;
+      Result *r = &baseline[i];
+      char *p = (char *)runs + strlen("\"runs\": [");
+      while (r->num_runs < MAX_RUNS) {
+        char *end;
+        double x = strtod(p, &end);
+        if (end == p) break;
+        r->run_ns[r->num_runs++] = x;
+        p = end + strspn(end, ", ");
+      }
+      mean_stddev(r->run_ns, r->num_runs, &r->mean, &r->stddev);
+    }
+  }
+  fclose(f);
+  return 0;
+}
+
+// Regularized incomplete beta function I_x(a, b), by its continued
+// fraction (modified Lentz's method)
+static double incomplete_beta(double a, double b, double x) {
+  if (x <= 0.0) return 0.0;
+  if (x >= 1.0) return 1.0;
+  // the continued fraction converges quickly for x < (a + 1) / (a + b + 2)
+  if (x > (a + 1.0) / (a + b + 2.0)) return 1.0 - incomplete_beta(b, a, 1.0 - x);
+
+  double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1.0 - x)) / a;
+  double c = 1.0, d = 1.0 - (a + b) * x / (a + 1.0);
+  if (fabs(d) < 1e-300) d = 1e-300;
+  d = 1.0 / d;
+  double f = d;
+  for (int m = 1; m <= 200; m++) {
+    for (int odd = 0; odd <= 1; odd++) {
+      double num = odd ? -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1))
+                       : m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+      d = 1.0 + num * d;
+      if (fabs(d) < 1e-300) d = 1e-300;
+      c = 1.0 + num / c;
+      if (fabs(c) < 1e-300) c = 1e-300;
+      d = 1.0 / d;
+      f *= c * d;
+    }
+    if (fabs(c * d - 1.0) < 1e-12) break;
+  }
+  return front * f;
+}
+
+// One-sided Welch's t-test of the hypothesis that the mean of the current
+// runs exceeds the baseline mean by more than the given factor.  Returns
+// the p-value: small values mean the slowdown is unlikely to be noise.
+static double slowdown_p_value(const Result *base, const Result *cur, double factor) {
+  double vb = factor * factor * base->stddev * base->stddev / base->num_runs;
+  double vc = cur->stddev * cur->stddev / cur->num_runs;
+  double diff = cur->mean - factor * base->mean;
+  if (vb + vc == 0.0) return diff > 0.0 ? 0.0 : 1.0;
+
+  double t = diff / sqrt(vb + vc);
+  // Welch-Satterthwaite degrees of freedom
+  double df = (vb + vc) * (vb + vc)
+              / (vb * vb / (base->num_runs - 1) + vc * vc / (cur->num_runs - 1));
+  double tail = 0.5 * incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+  return t > 0.0 ? tail : 1.0 - tail;
+}
+
+// Compare the results against a baseline, printing a report to out.
+// Returns the number of regressions.
+static int compare_baseline(FILE *out, const Result *results, const Result *baseline,
+                            const int *selected, double threshold, double alpha) {
+  int regressions = 0;
+
+  fprintf(out, "\n%-36s %10s %10s %8s %9s\n", "benchmark", "base ns", "ns/op", "change", "p-value");
+  for (int i = 0; i < NUM_BENCHES; i++) {
+    if (!selected[i]) continue;
+    char name[128];
+    snprintf(name, sizeof(name), "%s (%s)", benches[i].op, benches[i].input);
+    if (baseline[i].num_runs < 2) {
+      fprintf(out, "%-36s %10s %10.2f  (not in baseline)\n", name, "-", results[i].mean);
+      continue;
+    }
+    double p = slowdown_p_value(&baseline[i], &results[i], 1.0 + threshold / 100.0);
+    int regressed = p < alpha;
+    regressions += regressed;
+    fprintf(out, "%-36s %10.2f %10.2f %+7.1f%% %9.4f%s\n", name, baseline[i].mean,
+            results[i].mean, 100.0 * (results[i].mean / baseline[i].mean - 1.0), p,
+            regressed ? "  REGRESSION" : "");
+  }
+  return regressions;
+}
+
+// Compare fixedpoint_div against the bit-serial reference
+static int check_div(void) {
+  long mismatches = 0;
+
+  for (int i = 0; i < NUM_OPERANDS; i++) {
+    Fixedpoint l = mixed[0][i], r = mixed[1][i];
+    if (!same_result(fixedpoint_div(l, r), div_bitserial(l, r))) {
+      if (mismatches++ < 10) {
+        printf("mismatch: %lx.%016lx / %lx.%016lx\n", l.whole, l.frac, r.whole, r.frac);
+      }
+    }
+  }
+  if (mismatches) {
+    printf("fixedpoint_div: %ld mismatches in %d checks\n", mismatches, NUM_OPERANDS);
+  }
+  return mismatches != 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options] [rounds [filter]]\n"
+          "  rounds            passes over the operands per run (default 20)\n"
+          "  filter            only run benchmarks whose name contains this\n"
+          "  --runs N          repeat each benchmark N times (default 5)\n"
+          "  --json FILE       write the results as JSON (\"-\" for stdout)\n"
+          "  --compare FILE    compare against a baseline written by --json;\n"
+          "                    exit with status 1 if any benchmark regressed\n"
+          "  --threshold PCT   slowdown tolerated by --compare (default 5)\n"
+          "  --alpha P         significance level of --compare (default 0.01)\n"
+          "  --counters        also report hardware performance counters per op\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  int rounds = 20, runs = 5, num_args = 0;
+  const char *filter = "", *json_path = NULL, *baseline_path = NULL;
+  double threshold = 5.0, alpha = 0.01;
+  int counters = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    int has_value = i + 1 < argc;
+    if (strcmp(opt, "--runs") == 0 && has_value) {
+      runs = atoi(argv[++i]);
+    } else if (strcmp(opt, "--json") == 0 && has_value) {
+      json_path = argv[++i];
+    } else if (strcmp(opt, "--compare") == 0 && has_value) {
+      baseline_path = argv[++i];
+    } else if (strcmp(opt, "--threshold") == 0 && has_value) {
+      threshold = atof(argv[++i]);
+    } else if (strcmp(opt, "--alpha") == 0 && has_value) {
+      alpha = atof(argv[++i]);
+    } else if (strcmp(opt, "--counters") == 0) {
+      counters = 1;
+    } else if (opt[0] == '-' && opt[1] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else if (num_args == 0) {
+      rounds = atoi(opt);
+      num_args++;
+    } else {
+      filter = opt;
+    }
+  }
+  if (rounds < 1) rounds = 1;
+  if (runs < 2) runs = 2; // the statistics need at least two runs
+  if (runs > MAX_RUNS) runs = MAX_RUNS;
+
+  static Result results[NUM_BENCHES], baseline[NUM_BENCHES];
+  int selected[NUM_BENCHES];
+  if (baseline_path && read_baseline(baseline_path, baseline) != 0) {
+    perror(baseline_path);
+    return 2;
+  }
+
+  init_operands();
+  if (check_div()) return 1;
+
+  // with JSON on stdout, the table goes to stderr
+  FILE *table = (json_path && strcmp(json_path, "-") == 0) ? stderr : stdout;
+  if (counters && open_counters() == 0) {
+    fprintf(table, "hardware performance counters are not available "
+            "(see /proc/sys/kernel/perf_event_paranoid)\n");
+    counters = 0;
+  }
+  fprintf(table, "instruction set: %s, %d operands, %d runs of %d rounds\n",
+          fixedpoint_isa_name(fixedpoint_isa()), NUM_OPERANDS, runs, rounds);
+  fprintf(table, "%-36s %9s %8s %10s %9s %9s %9s\n",
+          "benchmark", "ns/op", "stddev", "Mops/s", "p50", "p90", "p99");
+  for (int i = 0; i < NUM_BENCHES; i++) {
+    char name[128];
+    snprintf(name, sizeof(name), "%s (%s)", benches[i].op, benches[i].input);
+    selected[i] = strstr(name, filter) != NULL;
+    if (!selected[i]) continue;
+    Result *r = &results[i];
+    run_bench(&benches[i], runs, rounds, r);
+    fprintf(table, "%-36s %9.2f %8.2f %10.2f %9.2f %9.2f %9.2f\n", name, r->mean, r->stddev,
+            1e3 / r->mean, r->p50, r->p90, r->p99);
+  }
+  if (counters) {
+    print_counters(table, results, selected);
+    close_counters();
+  }
+
+  if (json_path) {
+    FILE *out = (strcmp(json_path, "-") == 0) ? stdout : fopen(json_path, "w");
+    if (!out) {
+      perror(json_path);
+      return 2;
+    }
+    write_json(out, results, selected, rounds);
+    if (out != stdout) fclose(out);
+  }
+
+  // keep the compiler from discarding the results
+  if (bench_sink == 42) printf(" ");
+
+  if (baseline_path) {
+    int regressions = compare_baseline(table, results, baseline, selected, threshold, alpha);
+    fprintf(table, "%d regression(s) beyond %.1f%% (alpha %g)\n", regressions, threshold, alpha);
+    return regressions != 0;
+  }
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixedpoint_dispatch.h"
+#include "fixedpoint_internal.h"
+
+#define NUM_ISAS (FIXEDPOINT_ISA_AVX512 + 1)
+
+static const char *const isa_names[NUM_ISAS] = { "scalar", "sse4.2", "avx2", "avx512" };
+
+// Features detected by detect_cpu
+static enum FixedpointIsa best_isa = FIXEDPOINT_ISA_SCALAR;
+static int has_mulx_adx;
+
+// Copy of the kernel table for the selected level, with the multiply
+// kernel replaced if mulx/adx can be used
+static FpKernels selected;
+static enum FixedpointIsa current_isa;
+
+const FpKernels *fp_active_kernels;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void detect_cpu(void) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    best_isa = FIXEDPOINT_ISA_SSE42;
+    if (__builtin_cpu_supports("avx2")) {
+      best_isa = FIXEDPOINT_ISA_AVX2;
+      if (__builtin_cpu_supports("avx512f")) best_isa = FIXEDPOINT_ISA_AVX512;
+    }
+  }
+  has_mulx_adx = __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+#endif
+}
+
+static void bind(enum FixedpointIsa isa) {
+  const FpKernels *table = &fp_kernels_scalar;
+#if defined(__x86_64__)
+  switch (isa) {
+  case FIXEDPOINT_ISA_SSE42: table = &fp_kernels_sse42; break;
+  case FIXEDPOINT_ISA_AVX2: table = &fp_kernels_avx2; break;
+  case FIXEDPOINT_ISA_AVX512: table = &fp_kernels_avx512; break;
+  default: break;
+  }
+#endif
+  selected = *table;
+#if defined(__x86_64__)
+  if (isa >= FIXEDPOINT_ISA_AVX2 && has_mulx_adx) selected.mul = fp_mul_bmi2;
+#endif
+  current_isa = isa;
+  __atomic_store_n(&fp_active_kernels, &selected, __ATOMIC_RELEASE);
+}
+
+static void init(void) {
+  detect_cpu();
+
+  enum FixedpointIsa isa = best_isa;
+  const char *env = getenv("FIXEDPOINT_ISA");
+  if (env) {
+    for (int i = 0; i < NUM_ISAS; i++) {
+      if (strcmp(env, isa_names[i]) == 0 && (enum FixedpointIsa)i < best_isa) {
+        isa = (enum FixedpointIsa)i;
+      }
+    }
+  }
+  bind(isa);
+}
+
+const FpKernels *fp_kernels_init(void) {
+  pthread_once(&init_once, init);
+  return fp_active_kernels;
+}
+
+enum FixedpointIsa fixedpoint_isa(void) {
+  fp_kernels_init();
+  return current_isa;
+}
+
+enum FixedpointIsa fixedpoint_isa_best(void) {
+  fp_kernels_init();
+  return best_isa;
+}
+
+int fixedpoint_set_isa(enum FixedpointIsa isa) {
+  fp_kernels_init();
+  if (isa < FIXEDPOINT_ISA_SCALAR || isa > best_isa) {
+    return 0;
+  }
+  bind(isa);
+  return 1;
+}
+
+const char *fixedpoint_isa_name(enum FixedpointIsa isa) {
+  if (isa < FIXEDPOINT_ISA_SCALAR || isa >= NUM_ISAS) {
+    return "unknown";
+  }
+  return isa_names[isa];
+}
@@ -0,0 +1,55 @@
+#ifndef FIXEDPOINT_DISPATCH_H
+#define FIXEDPOINT_DISPATCH_H
+
+// Selection of the instruction set used by the batch kernels
+// (fixedpoint_array.h) and by fixedpoint_mul.
+//
+// On the first call to any of them, the library detects the features of
+// the CPU it runs on and uses the best supported level.  Setting the
+// FIXEDPOINT_ISA environment variable to "scalar", "sse4.2", "avx2" or
+// "avx512" forces a lower level (e.g. for benchmarking); a level the CPU
+// doesn't support falls back to the best supported level below it.
+//
+// Every level computes exactly the same results.
+
+// Instruction set levels, in increasing order
+enum FixedpointIsa {
+  FIXEDPOINT_ISA_SCALAR,
+  FIXEDPOINT_ISA_SSE42,
+  FIXEDPOINT_ISA_AVX2,   // also uses mulx/adcx if the CPU has BMI2 and ADX
+  FIXEDPOINT_ISA_AVX512,
+};
+
+// Get the instruction set level currently in use.
+//
+// Returns:
+//   the level
+enum FixedpointIsa fixedpoint_isa(void);
+
+// Get the best instruction set level the CPU supports.
+//
+// Returns:
+//   the level
+enum FixedpointIsa fixedpoint_isa_best(void);
+
+// Switch to another instruction set level.  Must not be called while
+// other threads are using the library.
+//
+// Parameters:
+//   isa - the level to use
+//
+// Returns:
+//   1 if the level is now in use, 0 if the CPU doesn't support it
+//   (in which case the level is unchanged)
+int fixedpoint_set_isa(enum FixedpointIsa isa);
+
+// Get the name of an instruction set level, as accepted in FIXEDPOINT_ISA.
+//
+// Parameters:
+//   isa - the level
+//
+// Returns:
+//   the name, or "unknown" if isa is not a valid level
+const char *fixedpoint_isa_name(enum FixedpointIsa isa);
+
+#endif // FIXEDPOINT_DISPATCH_H
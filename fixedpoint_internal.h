@@ -0,0 +1,213 @@
+#ifndef FIXEDPOINT_INTERNAL_H
+#define FIXEDPOINT_INTERNAL_H
+
+// Helpers shared by the Fixedpoint implementation files.
+// This header is not part of the public API.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fixedpoint.h"
+
+// 128-bit integer types (a GCC/Clang extension, hence __extension__ to keep
+// -pedantic quiet)
+__extension__ typedef unsigned __int128 fp_u128;
+__extension__ typedef __int128 fp_i128;
+
+// Get the magnitude of a Fixedpoint value as a single 128-bit Q64.64 integer.
+static inline fp_u128 fp_magnitude(Fixedpoint val) {
+  return ((fp_u128)val.whole << 64) | val.frac;
+}
+
+// Build a Fixedpoint value from a 128-bit Q64.64 magnitude and a tag.
+static inline Fixedpoint fp_from_magnitude(fp_u128 mag, enum Tag tag) {
+  Fixedpoint val;
+  val.whole = (uint64_t)(mag >> 64);
+  val.frac = (uint64_t)mag;
+  val.tag = tag;
+  return val;
+}
+
+// Sign extension word of a valid value given as whole/frac/tag words:
+// all ones if the value is negative, 0 if it is non-negative (including
+// a zero with a negative tag).  If flip is 1, the opposite sign is used.
+static inline uint64_t fp_sign_mask(uint64_t whole, uint64_t frac, unsigned tag, unsigned flip) {
+  return -(uint64_t)(((tag == TAG_VALID_NEGATIVE) ^ flip) & ((whole | frac) != 0));
+}
+
+// Branch-free sum of two valid values given as whole/frac/tag words.
+// The result (value and tag) is exactly what fixedpoint_add returns.
+// If flip is 1, the sign of the right operand is inverted first, giving
+// the result of fixedpoint_sub.
+//
+// Both operands are converted to 129-bit two's complement (the sign mask
+// is the sign extension word), added with a carry chain, and converted
+// back; the sign extension word of the sum (-2..1) selects the tag.
+static inline void fp_addsub_words(uint64_t lw, uint64_t lf, unsigned lt,
+                                   uint64_t rw, uint64_t rf, unsigned rt, unsigned flip,
+                                   uint64_t *w, uint64_t *f, uint8_t *t) {
+  uint64_t ln = fp_sign_mask(lw, lf, lt, 0);
+  uint64_t rn = fp_sign_mask(rw, rf, rt, flip);
+  uint64_t lxf = (lf ^ ln) - ln;
+  uint64_t lxw = (lw ^ ln) + (ln & (lf == 0));
+  uint64_t rxf = (rf ^ rn) - rn;
+  uint64_t rxw = (rw ^ rn) + (rn & (rf == 0));
+
+  uint64_t sf = lxf + rxf;
+  uint64_t c1 = sf < lxf;
+  uint64_t sw = lxw + rxw + c1;
+  uint64_t c2 = (sw < lxw) | ((sw == lxw) & c1);
+  int64_t hi = (int64_t)ln + (int64_t)rn + (int64_t)c2;
+  // -2^128 fits in two's complement but its magnitude doesn't fit in 128 bits
+  hi -= (hi == -1) & ((sw | sf) == 0);
+
+  // back to a magnitude (wrapped modulo 2^128 on overflow)
+  uint64_t m = -(uint64_t)(hi < 0);
+  *f = (sf ^ m) - m;
+  *w = (sw ^ m) + (m & (sf == 0));
+  *t = (uint8_t)((hi == 1) * TAG_POS_OVERFLOW + (hi == -1) * TAG_VALID_NEGATIVE
+                 + (hi == -2) * TAG_NEG_OVERFLOW);
+}
+
+// Saturate a result of fp_addsub_words without branches: an overflow
+// result becomes the largest magnitude, with a valid tag of the same sign.
+static inline void fp_saturate_words(uint64_t *w, uint64_t *f, uint8_t *t) {
+  // only TAG_POS_OVERFLOW and TAG_NEG_OVERFLOW are >= TAG_POS_OVERFLOW
+  uint64_t m = -(uint64_t)(*t >= TAG_POS_OVERFLOW);
+  *w |= m;
+  *f |= m;
+  *t = (uint8_t)(*t - (m & TAG_POS_OVERFLOW));
+}
+
+// Branch-free fixedpoint_compare of two valid values given as
+// whole/frac/tag words.
+static inline int fp_compare_words(uint64_t lw, uint64_t lf, unsigned lt,
+                                   uint64_t rw, uint64_t rf, unsigned rt) {
+  uint64_t ln = fp_sign_mask(lw, lf, lt, 0);
+  uint64_t rn = fp_sign_mask(rw, rf, rt, 0);
+  // compare the two's complement forms: sign word first, then the low words
+  uint64_t lxw = (lw ^ ln) + (ln & (lf == 0)), lxf = (lf ^ ln) - ln;
+  uint64_t rxw = (rw ^ rn) + (rn & (rf == 0)), rxf = (rf ^ rn) - rn;
+  int sign_gt = (int64_t)ln > (int64_t)rn, sign_eq = ln == rn;
+  int greater = sign_gt | (sign_eq & ((lxw > rxw) | ((lxw == rxw) & (lxf > rxf))));
+  int less = (!sign_gt & !sign_eq) | (sign_eq & ((lxw < rxw) | ((lxw == rxw) & (lxf < rxf))));
+  return greater - less;
+}
+
+// fixedpoint_scale_pow2_round: multiply a valid value by 2^k with a
+// 128-bit funnel shift across the whole and fractional parts.  Only k and
+// mode, which are the same for a whole batch, are branched on.
+static inline Fixedpoint fp_scale_pow2(Fixedpoint val, int k, enum FixedpointRounding mode) {
+  fp_u128 mag = fp_magnitude(val);
+  unsigned neg = (val.tag == TAG_VALID_NEGATIVE) & (mag != 0);
+  fp_u128 res;
+  enum Tag tag;
+
+  if (k >= 0) {
+    // the bits shifted out at the top must all be zero
+    unsigned over = (k < 128) ? (mag >> (127 - k) >> 1) != 0 : mag != 0;
+    res = (k < 128) ? mag << k : 0;
+    tag = (enum Tag)(over ? TAG_POS_OVERFLOW + neg : neg);
+  } else {
+    unsigned s = 0U - (unsigned)k;
+    fp_u128 rem = (s < 128) ? mag & (((fp_u128)1 << s) - 1) : mag;
+    res = (s < 128) ? mag >> s : 0;
+    unsigned inexact = rem != 0;
+    unsigned up = 0;
+    switch (mode) {
+    case FIXEDPOINT_ROUND_EXACT:
+    case FIXEDPOINT_ROUND_TRUNC:
+      break;
+    case FIXEDPOINT_ROUND_FLOOR:
+      // rounding toward -infinity increases the magnitude of negative values
+      up = neg & inexact;
+      break;
+    case FIXEDPOINT_ROUND_NEAREST_EVEN:
+      if (s <= 128) {
+        fp_u128 half = (fp_u128)1 << (s - 1);
+        up = (rem > half) | ((rem == half) & (unsigned)res & 1);
+      }
+      break;
+    }
+    // (can't wrap: res < 2^127 here)
+    res += up;
+    // an underflow value keeps the sign even if truncated to zero (like
+    // fixedpoint_halve), a valid zero is non-negative
+    tag = (enum Tag)((mode == FIXEDPOINT_ROUND_EXACT && inexact) ? TAG_POS_UNDERFLOW + neg
+                                                                 : neg & (res != 0));
+  }
+  return fp_from_magnitude(res, tag);
+}
+
+// Batch add/sub over raw FixedpointArray columns (fixedpoint_simd.c):
+// d = l + r, or d = l - r if flip is 1, for n elements.  The destination
+// columns may be the same as the source columns.  The AVX2 and AVX-512
+// versions exist only on x86-64 and may only be called if the CPU
+// supports them.
+typedef void (*fp_addsub_kernel)(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                                 const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                                 const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                                 size_t n, unsigned flip);
+
+// Batch unary operation over raw columns: d = op(s), for n elements
+typedef void (*fp_unary_kernel)(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                                const uint64_t *sw, const uint64_t *sf, const uint8_t *st,
+                                size_t n);
+
+// Batch compare over raw columns: out[i] = compare(l[i], r[i])
+typedef void (*fp_compare_kernel)(int8_t *out,
+                                  const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                                  const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                                  size_t n);
+
+// Full 256-bit product of the 128-bit magnitudes (a1, a0) and (b1, b0),
+// stored least significant word first
+typedef void (*fp_mul_kernel)(uint64_t a1, uint64_t a0, uint64_t b1, uint64_t b0,
+                              uint64_t p[4]);
+
+// The set of kernels for one instruction set level
+typedef struct {
+  const char *name;
+  fp_addsub_kernel addsub;
+  fp_unary_kernel negate;
+  fp_unary_kernel halve;
+  fp_compare_kernel compare;
+  fp_mul_kernel mul;
+} FpKernels;
+
+void fp_addsub_scalar(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                      const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                      const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                      size_t n, unsigned flip);
+extern const FpKernels fp_kernels_scalar;
+#if defined(__x86_64__)
+void fp_addsub_avx2(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                    const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                    const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                    size_t n, unsigned flip);
+void fp_addsub_avx512(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                      const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                      const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                      size_t n, unsigned flip);
+void fp_mul_bmi2(uint64_t a1, uint64_t a0, uint64_t b1, uint64_t b0, uint64_t p[4]);
+extern const FpKernels fp_kernels_sse42;
+extern const FpKernels fp_kernels_avx2;
+extern const FpKernels fp_kernels_avx512;
+#endif
+
+// Allocate a zero-filled column of n elements of the given size, aligned
+// to FIXEDPOINT_ARRAY_ALIGN (fixedpoint_array.c), or return NULL if it
+// can't be allocated or its size in bytes doesn't fit in a size_t
+void *fp_alloc_column(size_t n, size_t elem_size);
+
+// Kernels selected by the dispatcher (fixedpoint_dispatch.c).  The first
+// call detects the CPU features and binds the best supported level, or
+// the one requested by the FIXEDPOINT_ISA environment variable.
+extern const FpKernels *fp_active_kernels;
+const FpKernels *fp_kernels_init(void);
+
+static inline const FpKernels *fp_kernels(void) {
+  const FpKernels *k = __atomic_load_n(&fp_active_kernels, __ATOMIC_ACQUIRE);
+  return k ? k : fp_kernels_init();
+}
+
+#endif // FIXEDPOINT_INTERNAL_H
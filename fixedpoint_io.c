@@ -0,0 +1,292 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fixedpoint_io.h"
+#include "fixedpoint_internal.h"
+
+// Initial size of the buffer used to read files that can't be mapped
+#define READ_CHUNK (1 << 16)
+
+// Minimum number of bytes parsed by each thread
+#define MIN_CHUNK (1 << 20)
+
+// Count the lines in a buffer: one per '\n', plus an unterminated last line
+static size_t count_lines(const char *buf, size_t len) {
+  const char *p = buf, *end = buf + len;
+  size_t n = 0;
+
+  while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+    n++;
+    p++;
+  }
+  if (len > 0 && buf[len - 1] != '\n') n++;
+  return n;
+}
+
+// A growable list of error records
+typedef struct {
+  FixedpointParseError *errors;
+  size_t num, cap;
+} ErrorList;
+
+static int add_error(ErrorList *list, size_t line, size_t column) {
+  if (list->num == list->cap) {
+    size_t new_cap = list->cap ? list->cap * 2 : 16;
+    FixedpointParseError *errors = realloc(list->errors, new_cap * sizeof(*errors));
+    if (!errors) return -1;
+    list->errors = errors;
+    list->cap = new_cap;
+  }
+  list->errors[list->num].line = line;
+  list->errors[list->num].column = column;
+  list->num++;
+  return 0;
+}
+
+// Parse the lines of buf into dst, starting at element first (so the
+// first line of buf is line first + 1 of the input)
+static int parse_lines(const char *buf, size_t len, FixedpointArray *dst, size_t first,
+                       ErrorList *errors) {
+  const char *p = buf, *end = buf + len;
+
+  for (size_t i = first; p < end; i++) {
+    const char *eol = memchr(p, '\n', end - p);
+    const char *next = eol ? eol + 1 : end;
+    size_t line_len = (eol ? eol : end) - p;
+    if (line_len > 0 && p[line_len - 1] == '\r') line_len--;
+
+    Fixedpoint val;
+    size_t consumed = fixedpoint_parse_hex(p, line_len, &val);
+    if (!fixedpoint_is_err(val) && consumed != line_len) {
+      // a valid value followed by something else
+      val = fp_from_magnitude(0, TAG_ERR);
+    }
+    if (fixedpoint_is_err(val) && add_error(errors, i + 1, consumed) != 0) {
+      return -1;
+    }
+    fixedpoint_array_set(dst, i, val);
+    p = next;
+  }
+  return 0;
+}
+
+// One chunk of the input, processed by one thread
+typedef struct {
+  const char *buf;
+  size_t len;
+  size_t first_line;   // index of the chunk's first line in the whole input
+  size_t num_lines;
+  FixedpointArray *dst;
+  ErrorList errors;
+  int failed;
+  pthread_t thread;
+  int thread_started;
+} Chunk;
+
+static void *count_chunk(void *arg) {
+  Chunk *chunk = arg;
+  chunk->num_lines = count_lines(chunk->buf, chunk->len);
+  return NULL;
+}
+
+static void *parse_chunk(void *arg) {
+  Chunk *chunk = arg;
+  chunk->failed = parse_lines(chunk->buf, chunk->len, chunk->dst, chunk->first_line,
+                              &chunk->errors) != 0;
+  return NULL;
+}
+
+// Run fn on every chunk, the first one on the calling thread
+static void run_chunks(Chunk *chunks, int n, void *(*fn)(void *)) {
+  for (int i = 1; i < n; i++) {
+    chunks[i].thread_started = pthread_create(&chunks[i].thread, NULL, fn, &chunks[i]) == 0;
+  }
+  fn(&chunks[0]);
+  for (int i = 1; i < n; i++) {
+    // if a thread couldn't be started, do its work here instead
+    if (chunks[i].thread_started) pthread_join(chunks[i].thread, NULL);
+    else fn(&chunks[i]);
+  }
+}
+
+// Split buf into at most nthreads chunks of about the same size, each
+// ending at a line boundary
+static int split_chunks(const char *buf, size_t len, int nthreads, Chunk *chunks) {
+  size_t pos = 0;
+  int n = 0;
+
+  for (int i = 0; i < nthreads && pos < len; i++) {
+    size_t stop = len;
+    if (i < nthreads - 1) {
+      // end the chunk just after the first newline past its share
+      size_t limit = len / nthreads * (i + 1);
+      if (limit < pos) limit = pos;
+      const char *eol = memchr(buf + limit, '\n', len - limit);
+      if (eol) stop = (size_t)(eol - buf) + 1;
+    }
+    chunks[n].buf = buf + pos;
+    chunks[n].len = stop - pos;
+    n++;
+    pos = stop;
+  }
+  return n;
+}
+
+int fixedpoint_load_hex_buffer_parallel(const char *buf, size_t len, int nthreads,
+                                        FixedpointLoad *load) {
+  load->values = NULL;
+  load->errors = NULL;
+  load->num_errors = 0;
+
+  if (nthreads <= 0) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpus > 0) ? (int)ncpus : 1;
+    // not worth starting a thread for less than MIN_CHUNK bytes
+    if ((size_t)nthreads > len / MIN_CHUNK) {
+      nthreads = (len / MIN_CHUNK > 0) ? (int)(len / MIN_CHUNK) : 1;
+    }
+  }
+
+  Chunk *chunks = calloc(nthreads, sizeof(Chunk));
+  if (!chunks) return -1;
+  int n = split_chunks(buf, len, nthreads, chunks);
+
+  // count the lines of each chunk, so that each one knows where in the
+  // output array its values go
+  size_t total = 0;
+  if (n > 0) run_chunks(chunks, n, count_chunk);
+  for (int i = 0; i < n; i++) {
+    chunks[i].first_line = total;
+    total += chunks[i].num_lines;
+  }
+
+  int rc = -1;
+  load->values = fixedpoint_array_create(total);
+  if (load->values) {
+    for (int i = 0; i < n; i++) chunks[i].dst = load->values;
+    if (n > 0) run_chunks(chunks, n, parse_chunk);
+
+    // merge the error lists, which are already in line order
+    int failed = 0;
+    size_t num_errors = 0;
+    for (int i = 0; i < n; i++) {
+      failed |= chunks[i].failed;
+      num_errors += chunks[i].errors.num;
+    }
+    if (!failed && num_errors > 0) {
+      load->errors = malloc(num_errors * sizeof(FixedpointParseError));
+      failed = load->errors == NULL;
+    }
+    if (!failed) {
+      for (int i = 0; i < n; i++) {
+        if (chunks[i].errors.num == 0) continue;
+        memcpy(load->errors + load->num_errors, chunks[i].errors.errors,
+               chunks[i].errors.num * sizeof(FixedpointParseError));
+        load->num_errors += chunks[i].errors.num;
+      }
+      rc = 0;
+    }
+  }
+
+  for (int i = 0; i < n; i++) free(chunks[i].errors.errors);
+  free(chunks);
+  if (rc != 0) {
+    fixedpoint_load_free(load);
+    errno = ENOMEM;
+  }
+  return rc;
+}
+
+int fixedpoint_load_hex_buffer(const char *buf, size_t len, FixedpointLoad *load) {
+  return fixedpoint_load_hex_buffer_parallel(buf, len, 1, load);
+}
+
+// Read everything from fd into a malloc'ed buffer
+static char *read_all(int fd, size_t *len) {
+  size_t cap = READ_CHUNK, n = 0;
+  char *buf = malloc(cap);
+  if (!buf) return NULL;
+
+  for (;;) {
+    if (n == cap) {
+      char *bigger = realloc(buf, cap * 2);
+      if (!bigger) {
+        free(buf);
+        return NULL;
+      }
+      buf = bigger;
+      cap *= 2;
+    }
+    ssize_t rc = read(fd, buf + n, cap - n);
+    if (rc == 0) break;
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      free(buf);
+      return NULL;
+    }
+    n += (size_t)rc;
+  }
+  *len = n;
+  return buf;
+}
+
+int fixedpoint_load_hex_fd(int fd, FixedpointLoad *load) {
+  return fixedpoint_load_hex_fd_parallel(fd, 1, load);
+}
+
+int fixedpoint_load_hex_fd_parallel(int fd, int nthreads, FixedpointLoad *load) {
+  struct stat st;
+  int rc, saved_errno;
+
+  if (fstat(fd, &st) != 0) return -1;
+
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    size_t len = (size_t)st.st_size;
+    char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, len, MADV_SEQUENTIAL);
+      rc = fixedpoint_load_hex_buffer_parallel(map, len, nthreads, load);
+      saved_errno = errno;
+      munmap(map, len);
+      errno = saved_errno;
+      return rc;
+    }
+    // fall back to reading the file
+  }
+
+  size_t len;
+  char *buf = read_all(fd, &len);
+  if (!buf) return -1;
+  rc = fixedpoint_load_hex_buffer_parallel(buf, len, nthreads, load);
+  saved_errno = errno;
+  free(buf);
+  errno = saved_errno;
+  return rc;
+}
+
+int fixedpoint_load_hex_file(const char *path, FixedpointLoad *load) {
+  return fixedpoint_load_hex_file_parallel(path, 1, load);
+}
+
+int fixedpoint_load_hex_file_parallel(const char *path, int nthreads, FixedpointLoad *load) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return -1;
+  int rc = fixedpoint_load_hex_fd_parallel(fd, nthreads, load);
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return rc;
+}
+
+void fixedpoint_load_free(FixedpointLoad *load) {
+  fixedpoint_array_destroy(load->values);
+  free(load->errors);
+  load->values = NULL;
+  load->errors = NULL;
+  load->num_errors = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef FIXEDPOINT_IO_H
+#define FIXEDPOINT_IO_H
+
+#include <stddef.h>
+#include "fixedpoint.h"
+#include "fixedpoint_array.h"
+
+// Bulk loading of newline-delimited hex values, one per line, in the
+// format accepted by fixedpoint_create_from_hex.  Lines may end in "\n"
+// or "\r\n", and the last line doesn't need a line ending.  The values are
+// parsed straight out of the input (a memory-mapped file where possible),
+// without creating a string for each line.
+
+// Position of a line that couldn't be parsed
+typedef struct {
+  size_t line;   // line number, starting at 1
+  size_t column; // offset of the offending character within the line
+} FixedpointParseError;
+
+// Result of loading a file or buffer
+typedef struct {
+  FixedpointArray *values;       // one element per line; lines that couldn't
+                                 // be parsed hold an error value
+  FixedpointParseError *errors;  // the lines that couldn't be parsed, in order
+  size_t num_errors;             // the number of entries in errors
+} FixedpointLoad;
+
+// Load the values in a memory buffer.
+//
+// Parameters:
+//   buf - the characters to parse (need not be NUL-terminated)
+//   len - the number of characters
+//   load - where the result is stored; must be freed with
+//          fixedpoint_load_free if the call succeeds
+//
+// Returns:
+//   0 if successful (even if some lines couldn't be parsed);
+//   -1 if memory couldn't be allocated
+int fixedpoint_load_hex_buffer(const char *buf, size_t len, FixedpointLoad *load);
+
+// Load the values in a file, reading it through the given file
+// descriptor until end of file.  Regular files are memory-mapped; other
+// files (e.g. pipes) are read into memory.
+//
+// Parameters:
+//   fd - the file descriptor
+//   load - where the result is stored; must be freed with
+//          fixedpoint_load_free if the call succeeds
+//
+// Returns:
+//   0 if successful (even if some lines couldn't be parsed);
+//   -1 on an I/O or memory allocation error (errno is set)
+int fixedpoint_load_hex_fd(int fd, FixedpointLoad *load);
+
+// Load the values in the named file, as fixedpoint_load_hex_fd.
+//
+// Parameters:
+//   path - the name of the file
+//   load - where the result is stored; must be freed with
+//          fixedpoint_load_free if the call succeeds
+//
+// Returns:
+//   0 if successful (even if some lines couldn't be parsed);
+//   -1 on an I/O or memory allocation error (errno is set)
+int fixedpoint_load_hex_file(const char *path, FixedpointLoad *load);
+
+// Parallel versions of the functions above: the input is split into
+// nthreads parts at line boundaries, which are parsed by separate threads.
+// The result is the same as with a single thread.  If nthreads is 0, the
+// number of online CPUs is used, but no more than one per MiB of input.
+int fixedpoint_load_hex_buffer_parallel(const char *buf, size_t len, int nthreads,
+                                        FixedpointLoad *load);
+int fixedpoint_load_hex_fd_parallel(int fd, int nthreads, FixedpointLoad *load);
+int fixedpoint_load_hex_file_parallel(const char *path, int nthreads, FixedpointLoad *load);
+
+// Free the memory held by the result of a load.
+//
+// Parameters:
+//   load - the result
+void fixedpoint_load_free(FixedpointLoad *load);
+
+#endif // FIXEDPOINT_IO_H
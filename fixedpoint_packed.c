@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fixedpoint_packed.h"
+#include "fixedpoint_internal.h"
+
+// Number of elements processed at a time by the batch operations: the
+// tags of a block are unpacked into small buffers on the stack, and the
+// kernels selected at runtime run on the block
+#define BLOCK 256
+
+// Initial number of entries of an exception table
+#define MIN_EXCEPTIONS 16
+
+FixedpointPackedArray *fixedpoint_packed_create(size_t len) {
+  FixedpointPackedArray *arr = malloc(sizeof(FixedpointPackedArray));
+  if (!arr) return NULL;
+
+  arr->whole = fp_alloc_column(len, sizeof(uint64_t));
+  arr->frac = fp_alloc_column(len, sizeof(uint64_t));
+  arr->sign = fp_alloc_column(len / 64 + (len % 64 != 0), sizeof(uint64_t));
+  arr->exceptions = NULL;
+  arr->num_exceptions = 0;
+  arr->exceptions_capacity = 0;
+  arr->len = len;
+  if (!arr->whole || !arr->frac || !arr->sign) {
+    fixedpoint_packed_destroy(arr);
+    return NULL;
+  }
+  return arr;
+}
+
+void fixedpoint_packed_destroy(FixedpointPackedArray *arr) {
+  if (!arr) return;
+  free(arr->whole);
+  free(arr->frac);
+  free(arr->sign);
+  free(arr->exceptions);
+  free(arr);
+}
+
+static inline unsigned sign_bit(const FixedpointPackedArray *arr, size_t i) {
+  return (arr->sign[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void set_sign_bit(FixedpointPackedArray *arr, size_t i, unsigned bit) {
+  uint64_t mask = 1UL << (i % 64);
+  arr->sign[i / 64] = (arr->sign[i / 64] & ~mask) | (-(uint64_t)bit & mask);
+}
+
+// Index of the first exception table entry for an element >= i
+static size_t find_exception(const FixedpointPackedArray *arr, size_t i) {
+  size_t lo = 0, hi = arr->num_exceptions;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (arr->exceptions[mid].index < i) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Make sure the exception table has room for num entries
+static int reserve_exceptions(FixedpointPackedArray *arr, size_t num) {
+  if (num <= arr->exceptions_capacity) return 1;
+  size_t capacity = arr->exceptions_capacity ? arr->exceptions_capacity : MIN_EXCEPTIONS;
+  while (capacity < num) capacity *= 2;
+  FixedpointPackedException *exceptions =
+    realloc(arr->exceptions, capacity * sizeof(FixedpointPackedException));
+  if (!exceptions) return 0;
+  arr->exceptions = exceptions;
+  arr->exceptions_capacity = capacity;
+  return 1;
+}
+
+// The exceptions produced by a batch operation, in index order
+typedef struct {
+  FixedpointPackedException *items;
+  size_t num, capacity;
+} ExceptionList;
+
+static int exception_list_add(ExceptionList *list, size_t index, uint8_t tag) {
+  if (list->num == list->capacity) {
+    size_t capacity = list->capacity ? 2 * list->capacity : MIN_EXCEPTIONS;
+    FixedpointPackedException *items =
+      realloc(list->items, capacity * sizeof(FixedpointPackedException));
+    if (!items) return 0;
+    list->items = items;
+    list->capacity = capacity;
+  }
+  list->items[list->num].index = index;
+  list->items[list->num].tag = tag;
+  list->num++;
+  return 1;
+}
+
+// Replace the exception table entries for the elements start .. start+n-1
+// by the entries of list
+static int replace_exceptions(FixedpointPackedArray *arr, size_t start, size_t n,
+                              const ExceptionList *list) {
+  size_t lo = find_exception(arr, start), hi = find_exception(arr, start + n);
+  size_t num = arr->num_exceptions - (hi - lo) + list->num;
+  if (!reserve_exceptions(arr, num)) return 0;
+  if (hi - lo != list->num) {
+    memmove(arr->exceptions + lo + list->num, arr->exceptions + hi,
+            (arr->num_exceptions - hi) * sizeof(FixedpointPackedException));
+  }
+  if (list->num) {
+    memcpy(arr->exceptions + lo, list->items, list->num * sizeof(FixedpointPackedException));
+  }
+  arr->num_exceptions = num;
+  return 1;
+}
+
+Fixedpoint fixedpoint_packed_get(const FixedpointPackedArray *arr, size_t i) {
+  Fixedpoint val;
+  size_t k = find_exception(arr, i);
+  val.whole = arr->whole[i];
+  val.frac = arr->frac[i];
+  if (k < arr->num_exceptions && arr->exceptions[k].index == i) {
+    val.tag = (enum Tag)arr->exceptions[k].tag;
+  } else {
+    val.tag = sign_bit(arr, i) ? TAG_VALID_NEGATIVE : TAG_VALID_NONNEGATIVE;
+  }
+  return val;
+}
+
+int fixedpoint_packed_set(FixedpointPackedArray *arr, size_t i, Fixedpoint val) {
+  ExceptionList list = { NULL, 0, 0 };
+  FixedpointPackedException entry;
+  entry.index = i;
+  entry.tag = (uint8_t)val.tag;
+  if (val.tag > TAG_VALID_NEGATIVE) {
+    list.items = &entry;
+    list.num = 1;
+  }
+  if (!replace_exceptions(arr, i, 1, &list)) return 0;
+  arr->whole[i] = val.whole;
+  arr->frac[i] = val.frac;
+  set_sign_bit(arr, i, val.tag == TAG_VALID_NEGATIVE);
+  return 1;
+}
+
+// The batch operations below handle the sign bits a word at a time: m
+// elements starting at element i, which is bit i % 64 of its sign word.
+// Within a word, 8 tags are converted at once as the bytes of a uint64_t,
+// byte k holding tags[k].
+
+// Number of elements from element i to the end of its sign word, at most n
+static inline size_t word_run(size_t i, size_t n) {
+  return (64 - i % 64 < n) ? 64 - i % 64 : n;
+}
+
+// Byte k of a uint64_t is tags[k] in little-endian order
+static inline uint64_t to_little_endian(uint64_t x) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  x = __builtin_bswap64(x);
+#endif
+  return x;
+}
+
+// 8 bits -> 8 bytes that are 0 or 1: replicate the bits into every byte,
+// keep bit k in byte k, and turn each nonzero byte into 1
+static inline void spread_bits(uint8_t *tags, uint64_t bits) {
+  uint64_t x = (bits * 0x0101010101010101UL) & 0x8040201008040201UL;
+  x = ((x + 0x7f7f7f7f7f7f7f7fUL) >> 7) & 0x0101010101010101UL;
+  x = to_little_endian(x);
+  memcpy(tags, &x, sizeof(x));
+}
+
+// 8 tags -> 8 sign bits (bit k is set if tags[k] is TAG_VALID_NEGATIVE);
+// other is or'ed with a nonzero value if a tag isn't a valid one
+static inline uint64_t gather_bits(const uint8_t *tags, uint64_t *other) {
+  uint64_t x;
+  memcpy(&x, tags, sizeof(x));
+  x = to_little_endian(x);
+  *other |= x & 0xfefefefefefefefeUL;
+  // with only valid tags, each byte is 0 or 1: gather bit 0 of byte k
+  // into bit 56 + k
+  return ((x & 0x0101010101010101UL) * 0x0102040810204080UL) >> 56;
+}
+
+// Unpack the sign bits of the elements start .. start+n-1 into tags
+static void unpack_signs(uint8_t *tags, const FixedpointPackedArray *arr, size_t start, size_t n) {
+  for (size_t i = 0, m; i < n; i += m) {
+    m = word_run(start + i, n - i);
+    uint64_t bits = arr->sign[(start + i) / 64] >> ((start + i) % 64);
+    size_t j = 0;
+    for (; j + 8 <= m; j += 8) spread_bits(tags + i + j, (bits >> j) & 0xff);
+    for (; j < m; j++) tags[i + j] = (uint8_t)((bits >> j) & 1);
+  }
+}
+
+// Pack the tags of the elements start .. start+n-1: the sign of a valid
+// element goes to its sign bit, the tag of any other element to list
+static int pack_tags(FixedpointPackedArray *arr, size_t start, const uint8_t *tags, size_t n,
+                     ExceptionList *list) {
+  uint64_t other = 0;
+  for (size_t i = 0, m; i < n; i += m) {
+    m = word_run(start + i, n - i);
+    uint64_t bits = 0;
+    size_t j = 0;
+    for (; j + 8 <= m; j += 8) bits |= gather_bits(tags + i + j, &other) << j;
+    for (; j < m; j++) {
+      bits |= (uint64_t)(tags[i + j] & 1) << j;
+      other |= tags[i + j] & ~1U;
+    }
+    unsigned shift = (start + i) % 64;
+    uint64_t mask = ((m == 64) ? ~0UL : (1UL << m) - 1) << shift;
+    uint64_t *word = &arr->sign[(start + i) / 64];
+    *word = (*word & ~mask) | (bits << shift);
+  }
+  if (!other) return 1;
+  // some results aren't valid: clear their sign bits, and record them
+  for (size_t i = 0; i < n; i++) {
+    if (tags[i] > TAG_VALID_NEGATIVE) {
+      set_sign_bit(arr, start + i, 0);
+      if (!exception_list_add(list, start + i, tags[i])) return 0;
+    }
+  }
+  return 1;
+}
+
+int fixedpoint_packed_pack(FixedpointPackedArray *dst, const FixedpointArray *src,
+                           size_t start, size_t n) {
+  ExceptionList list = { NULL, 0, 0 };
+  int ok;
+  memcpy(dst->whole + start, src->whole + start, n * sizeof(uint64_t));
+  memcpy(dst->frac + start, src->frac + start, n * sizeof(uint64_t));
+  ok = pack_tags(dst, start, src->tag + start, n, &list)
+       && replace_exceptions(dst, start, n, &list);
+  free(list.items);
+  return ok;
+}
+
+void fixedpoint_packed_unpack(FixedpointArray *dst, const FixedpointPackedArray *src,
+                              size_t start, size_t n) {
+  memcpy(dst->whole + start, src->whole + start, n * sizeof(uint64_t));
+  memcpy(dst->frac + start, src->frac + start, n * sizeof(uint64_t));
+  unpack_signs(dst->tag + start, src, start, n);
+  for (size_t k = find_exception(src, start);
+       k < src->num_exceptions && src->exceptions[k].index < start + n; k++) {
+    dst->tag[src->exceptions[k].index] = src->exceptions[k].tag;
+  }
+}
+
+// add and sub only differ in whether the right operand's sign is flipped
+static int addsub(FixedpointPackedArray *dst, const FixedpointPackedArray *left,
+                  const FixedpointPackedArray *right, size_t start, size_t n, unsigned flip) {
+  const FpKernels *kernels = fp_kernels();
+  uint8_t lt[BLOCK], rt[BLOCK], dt[BLOCK];
+  ExceptionList list = { NULL, 0, 0 };
+  int ok = 1;
+
+  for (size_t s = start; ok && s < start + n; s += BLOCK) {
+    size_t m = (start + n - s < BLOCK) ? start + n - s : BLOCK;
+    unpack_signs(lt, left, s, m);
+    unpack_signs(rt, right, s, m);
+    kernels->addsub(dst->whole + s, dst->frac + s, dt, left->whole + s, left->frac + s, lt,
+                    right->whole + s, right->frac + s, rt, m, flip);
+    ok = pack_tags(dst, s, dt, m, &list);
+  }
+  ok = ok && replace_exceptions(dst, start, n, &list);
+  free(list.items);
+  return ok;
+}
+
+static int unary(FixedpointPackedArray *dst, const FixedpointPackedArray *src,
+                 size_t start, size_t n, fp_unary_kernel kernel) {
+  uint8_t st[BLOCK], dt[BLOCK];
+  ExceptionList list = { NULL, 0, 0 };
+  int ok = 1;
+
+  for (size_t s = start; ok && s < start + n; s += BLOCK) {
+    size_t m = (start + n - s < BLOCK) ? start + n - s : BLOCK;
+    unpack_signs(st, src, s, m);
+    kernel(dst->whole + s, dst->frac + s, dt, src->whole + s, src->frac + s, st, m);
+    ok = pack_tags(dst, s, dt, m, &list);
+  }
+  ok = ok && replace_exceptions(dst, start, n, &list);
+  free(list.items);
+  return ok;
+}
+
+int fixedpoint_packed_add(FixedpointPackedArray *dst, const FixedpointPackedArray *left,
+                          const FixedpointPackedArray *right, size_t start, size_t n) {
+  return addsub(dst, left, right, start, n, 0);
+}
+
+int fixedpoint_packed_sub(FixedpointPackedArray *dst, const FixedpointPackedArray *left,
+                          const FixedpointPackedArray *right, size_t start, size_t n) {
+  return addsub(dst, left, right, start, n, 1);
+}
+
+void fixedpoint_packed_negate(FixedpointPackedArray *dst, const FixedpointPackedArray *src,
+                              size_t start, size_t n) {
+  // no exceptions are produced, so the table only shrinks
+  (void)unary(dst, src, start, n, fp_kernels()->negate);
+}
+
+int fixedpoint_packed_halve(FixedpointPackedArray *dst, const FixedpointPackedArray *src,
+                            size_t start, size_t n) {
+  return unary(dst, src, start, n, fp_kernels()->halve);
+}
+
+int fixedpoint_packed_double(FixedpointPackedArray *dst, const FixedpointPackedArray *src,
+                             size_t start, size_t n) {
+  return addsub(dst, src, src, start, n, 0);
+}
+
+void fixedpoint_packed_compare(int8_t *out, const FixedpointPackedArray *left,
+                               const FixedpointPackedArray *right, size_t start, size_t n) {
+  const FpKernels *kernels = fp_kernels();
+  uint8_t lt[BLOCK], rt[BLOCK];
+
+  for (size_t s = start; s < start + n; s += BLOCK) {
+    size_t m = (start + n - s < BLOCK) ? start + n - s : BLOCK;
+    unpack_signs(lt, left, s, m);
+    unpack_signs(rt, right, s, m);
+    kernels->compare(out + (s - start), left->whole + s, left->frac + s, lt,
+                     right->whole + s, right->frac + s, rt, m);
+  }
+}
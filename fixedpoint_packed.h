@@ -0,0 +1,133 @@
+#ifndef FIXEDPOINT_PACKED_H
+#define FIXEDPOINT_PACKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fixedpoint.h"
+#include "fixedpoint_array.h"
+
+// An entry of the exception table of a FixedpointPackedArray: an element
+// whose tag is neither TAG_VALID_NONNEGATIVE nor TAG_VALID_NEGATIVE
+typedef struct {
+  size_t index; // index of the element
+  uint8_t tag;  // its tag (enum Tag value)
+} FixedpointPackedException;
+
+// A compact array of Fixedpoint values: 16 bytes per element plus one
+// sign bit, instead of the 17 bytes of a FixedpointArray or the 24 bytes
+// of a Fixedpoint.  The magnitude uses all 128 bits, so the tag can't be
+// folded into the whole and fractional parts; instead, the sign of each
+// valid element is kept in a bitmap, and the tags of the (normally rare)
+// non-valid elements in a sparse table sorted by index.  Conversion to
+// and from Fixedpoint values is lossless.
+//
+// The batch operations below work on the packed columns directly, a
+// block of elements at a time, and compute exactly what the corresponding
+// scalar function would for each element.  Like the FixedpointArray
+// operations, they are only defined for valid operands, operate on the
+// elements start .. start+n-1 of their arguments, and allow the
+// destination to be the same array as a source.  Operations that can
+// produce overflow or underflow record those results in the destination's
+// exception table, and return 0 if memory for it couldn't be allocated
+// (the elements in the range are then unspecified), 1 otherwise.
+typedef struct {
+  uint64_t *whole;                       // whole parts
+  uint64_t *frac;                        // fractional parts
+  uint64_t *sign;                        // bit i % 64 of word i / 64: element i is negative
+  FixedpointPackedException *exceptions; // non-valid elements, sorted by index
+  size_t num_exceptions;                 // number of entries in exceptions
+  size_t exceptions_capacity;            // number of entries allocated
+  size_t len;                            // number of elements
+} FixedpointPackedArray;
+
+// Create a packed array of len elements, all equal to zero.
+//
+// Parameters:
+//   len - the number of elements
+//
+// Returns:
+//   pointer to the new array, or NULL if memory couldn't be allocated
+FixedpointPackedArray *fixedpoint_packed_create(size_t len);
+
+// Free an array created by fixedpoint_packed_create.
+//
+// Parameters:
+//   arr - the array (may be NULL)
+void fixedpoint_packed_destroy(FixedpointPackedArray *arr);
+
+// Get element i of a packed array.
+//
+// Parameters:
+//   arr - the array
+//   i - the index of the element
+//
+// Returns:
+//   the element as a Fixedpoint value
+Fixedpoint fixedpoint_packed_get(const FixedpointPackedArray *arr, size_t i);
+
+// Set element i of a packed array.  Any value can be stored, including
+// non-valid ones.
+//
+// Parameters:
+//   arr - the array
+//   i - the index of the element
+//   val - the new value of the element
+//
+// Returns:
+//   1 if successful, 0 if memory for the exception table couldn't be
+//   allocated (the element is then unchanged)
+int fixedpoint_packed_set(FixedpointPackedArray *arr, size_t i, Fixedpoint val);
+
+// Copy n elements of a FixedpointArray, starting at element start, into
+// the same elements of a packed array.
+//
+// Parameters:
+//   dst - the packed array
+//   src - the array to copy from
+//   start - index of the first element to copy
+//   n - the number of elements
+//
+// Returns:
+//   1 if successful, 0 if memory for the exception table couldn't be
+//   allocated
+int fixedpoint_packed_pack(FixedpointPackedArray *dst, const FixedpointArray *src,
+                           size_t start, size_t n);
+
+// Copy n elements of a packed array, starting at element start, into the
+// same elements of a FixedpointArray.
+//
+// Parameters:
+//   dst - the array to copy to
+//   src - the packed array
+//   start - index of the first element to copy
+//   n - the number of elements
+void fixedpoint_packed_unpack(FixedpointArray *dst, const FixedpointPackedArray *src,
+                              size_t start, size_t n);
+
+// Element-wise fixedpoint_add of valid values: dst = left + right.
+int fixedpoint_packed_add(FixedpointPackedArray *dst, const FixedpointPackedArray *left,
+                          const FixedpointPackedArray *right, size_t start, size_t n);
+
+// Element-wise fixedpoint_sub of valid values: dst = left - right.
+int fixedpoint_packed_sub(FixedpointPackedArray *dst, const FixedpointPackedArray *left,
+                          const FixedpointPackedArray *right, size_t start, size_t n);
+
+// Element-wise fixedpoint_negate of valid values: dst = -src.  This can't
+// fail.
+void fixedpoint_packed_negate(FixedpointPackedArray *dst, const FixedpointPackedArray *src,
+                              size_t start, size_t n);
+
+// Element-wise fixedpoint_halve of valid values: dst = src / 2.
+int fixedpoint_packed_halve(FixedpointPackedArray *dst, const FixedpointPackedArray *src,
+                            size_t start, size_t n);
+
+// Element-wise fixedpoint_double of valid values: dst = src * 2.
+int fixedpoint_packed_double(FixedpointPackedArray *dst, const FixedpointPackedArray *src,
+                             size_t start, size_t n);
+
+// Element-wise fixedpoint_compare of valid values.  The result for element
+// start+i is stored in out[i] (-1, 0, or 1).
+void fixedpoint_packed_compare(int8_t *out, const FixedpointPackedArray *left,
+                               const FixedpointPackedArray *right, size_t start, size_t n);
+
+#endif // FIXEDPOINT_PACKED_H
@@ -0,0 +1,525 @@
+// Property-based differential tests: random and edge-biased Q64.64
+// values are run through the library, and each result is checked
+// against a reference model that works on a sign and an unsigned
+// __int128 magnitude.  Failing cases are shrunk to a simpler failing
+// case and reported together with the seed and case number needed to
+// reproduce them.
+//
+// Usage: fixedpoint_proptest [-n cases] [-j threads] [-s seed] [-c first_case]
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fixedpoint.h"
+#include "fixedpoint_array.h"
+#include "fixedpoint_dispatch.h"
+#include "fixedpoint_internal.h"
+#include "fixedpoint_sort.h"
+#include "fixedpoint_sum.h"
+
+// Cases are checked in blocks, so the batch kernels see whole arrays
+#define BLOCK 1024
+
+// Maximum number of failures reported per property
+#define MAX_REPORTS 3
+
+// splitmix64: a fast generator whose state can be derived from the seed
+// and the case number, so any case can be regenerated on its own
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15UL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return z ^ (z >> 31);
+}
+
+// A random 64-bit word, biased towards values at the edges of the range
+// and around powers of two
+static uint64_t random_word(uint64_t *rng) {
+  uint64_t r = splitmix64(rng);
+  unsigned k = r & 63;
+  switch ((r >> 6) % 12) {
+  case 0: return 0;
+  case 1: return 1;
+  case 2: return UINT64_MAX;
+  case 3: return 1UL << 63;
+  case 4: return (1UL << 63) - 1;
+  case 5: return 1UL << k;
+  case 6: return (1UL << k) - 1;
+  case 7: return splitmix64(rng) >> k; // small
+  case 8: return splitmix64(rng) << k; // few low bits
+  default: return splitmix64(rng);
+  }
+}
+
+// A random valid value
+static Fixedpoint random_value(uint64_t *rng) {
+  Fixedpoint val = fixedpoint_create2(random_word(rng), random_word(rng));
+  if (splitmix64(rng) & 1) val = fixedpoint_negate(val);
+  return val;
+}
+
+// The pair of operands of a case: independent values, or the second one
+// close to (plus or minus) the first, to hit zero results and carries
+static void make_case(uint64_t seed, uint64_t index, Fixedpoint *a, Fixedpoint *b) {
+  uint64_t rng = seed ^ (index * 0xd1b54a32d192ed03UL);
+  *a = random_value(&rng);
+  switch (splitmix64(&rng) % 8) {
+  case 0: *b = *a; break;
+  case 1: *b = fixedpoint_negate(*a); break;
+  case 2: *b = fixedpoint_add(fixedpoint_negate(*a), fixedpoint_create2(0, random_word(&rng) & 7));
+    if (!fixedpoint_is_valid(*b)) *b = *a;
+    break;
+  default: *b = random_value(&rng); break;
+  }
+}
+
+// Reference model
+
+typedef struct {
+  int neg;
+  fp_u128 mag;
+} Ref;
+
+static Ref to_ref(Fixedpoint val) {
+  Ref r;
+  r.neg = fixedpoint_is_neg(val) && !fixedpoint_is_zero(val);
+  r.mag = fp_magnitude(val);
+  return r;
+}
+
+// A valid result: zero is never negative
+static Fixedpoint valid(int neg, fp_u128 mag) {
+  return fp_from_magnitude(mag, (neg && mag != 0) ? TAG_VALID_NEGATIVE : TAG_VALID_NONNEGATIVE);
+}
+
+static Fixedpoint ref_add(Fixedpoint left, Fixedpoint right) {
+  Ref a = to_ref(left), b = to_ref(right);
+  if (a.neg == b.neg) {
+    fp_u128 sum = a.mag + b.mag;
+    if (sum < a.mag) {
+      // the magnitude wraps around
+      return fp_from_magnitude(sum, a.neg ? TAG_NEG_OVERFLOW : TAG_POS_OVERFLOW);
+    }
+    return valid(a.neg, sum);
+  }
+  if (a.mag >= b.mag) return valid(a.neg, a.mag - b.mag);
+  return valid(b.neg, b.mag - a.mag);
+}
+
+static Fixedpoint ref_negate(Fixedpoint val) {
+  Ref r = to_ref(val);
+  return valid(!r.neg, r.mag);
+}
+
+static Fixedpoint ref_sub(Fixedpoint left, Fixedpoint right) {
+  return ref_add(left, ref_negate(right));
+}
+
+static Fixedpoint ref_halve(Fixedpoint val) {
+  Ref r = to_ref(val);
+  if (r.mag & 1) {
+    return fp_from_magnitude(r.mag >> 1, r.neg ? TAG_NEG_UNDERFLOW : TAG_POS_UNDERFLOW);
+  }
+  return valid(r.neg, r.mag >> 1);
+}
+
+static int ref_compare(Fixedpoint left, Fixedpoint right) {
+  Ref a = to_ref(left), b = to_ref(right);
+  if (a.neg != b.neg) return a.neg ? -1 : 1;
+  int c = (a.mag > b.mag) - (a.mag < b.mag);
+  return a.neg ? -c : c;
+}
+
+// Reference formatting, with printf
+static void ref_format(Fixedpoint val, char *buf) {
+  int n = sprintf(buf, "%s%" PRIx64, to_ref(val).neg ? "-" : "", val.whole);
+  if (val.frac != 0) {
+    n += sprintf(buf + n, ".%016" PRIx64, val.frac);
+    while (buf[n - 1] == '0') buf[--n] = '\0';
+  }
+}
+
+// Properties
+
+static int same(Fixedpoint a, Fixedpoint b) {
+  return a.tag == b.tag && a.whole == b.whole && a.frac == b.frac;
+}
+
+static int prop_add(Fixedpoint a, Fixedpoint b) {
+  return same(fixedpoint_add(a, b), ref_add(a, b));
+}
+
+static int prop_sub(Fixedpoint a, Fixedpoint b) {
+  return same(fixedpoint_sub(a, b), ref_sub(a, b));
+}
+
+// Saturating results: overflow clamps to the largest magnitude
+static Fixedpoint ref_saturate(Fixedpoint val) {
+  if (val.tag == TAG_POS_OVERFLOW || val.tag == TAG_NEG_OVERFLOW) {
+    return valid(val.tag == TAG_NEG_OVERFLOW, ~(fp_u128)0);
+  }
+  return val;
+}
+
+static int prop_add_sat(Fixedpoint a, Fixedpoint b) {
+  return same(fixedpoint_add_sat(a, b), ref_saturate(ref_add(a, b)))
+         && same(fixedpoint_sub_sat(a, b), ref_saturate(ref_sub(a, b)))
+         && same(fixedpoint_double_sat(a), ref_saturate(ref_add(a, a)));
+}
+
+// Scaling by 2^k, one bit at a time: the bits shifted out at the top make
+// an overflow; for the bits shifted out at the bottom, the last one is
+// the rounding bit and the others are or'ed into a sticky bit
+static Fixedpoint ref_scale_pow2(Fixedpoint val, int k, enum FixedpointRounding mode) {
+  Ref r = to_ref(val);
+  int over = 0;
+  unsigned round = 0, sticky = 0;
+  for (int i = 0; i < k; i++) {
+    over |= (int)(r.mag >> 127);
+    r.mag <<= 1;
+  }
+  for (int i = 0; i > k; i--) {
+    sticky |= round;
+    round = r.mag & 1;
+    r.mag >>= 1;
+  }
+  if (over) return fp_from_magnitude(r.mag, r.neg ? TAG_NEG_OVERFLOW : TAG_POS_OVERFLOW);
+  if (!(round | sticky)) return valid(r.neg, r.mag);
+  switch (mode) {
+  case FIXEDPOINT_ROUND_EXACT:
+    return fp_from_magnitude(r.mag, r.neg ? TAG_NEG_UNDERFLOW : TAG_POS_UNDERFLOW);
+  case FIXEDPOINT_ROUND_TRUNC: return valid(r.neg, r.mag);
+  case FIXEDPOINT_ROUND_FLOOR: return valid(r.neg, r.mag + r.neg);
+  default: return valid(r.neg, r.mag + (round & (sticky | (unsigned)(r.mag & 1))));
+  }
+}
+
+// k and the rounding mode come from the second operand
+static int prop_scale_pow2(Fixedpoint a, Fixedpoint b) {
+  int k = (int)(b.frac % 301) - 150;
+  enum FixedpointRounding mode = (enum FixedpointRounding)(b.whole & 3);
+  return same(fixedpoint_scale_pow2_round(a, k, mode), ref_scale_pow2(a, k, mode))
+         && same(fixedpoint_scale_pow2(a, k), ref_scale_pow2(a, k, FIXEDPOINT_ROUND_EXACT));
+}
+
+static int prop_halve(Fixedpoint a, Fixedpoint b) {
+  (void)b;
+  return same(fixedpoint_halve(a), ref_halve(a));
+}
+
+static int prop_double(Fixedpoint a, Fixedpoint b) {
+  (void)b;
+  return same(fixedpoint_double(a), ref_add(a, a));
+}
+
+static int prop_negate(Fixedpoint a, Fixedpoint b) {
+  (void)b;
+  return same(fixedpoint_negate(a), ref_negate(a))
+         && same(fixedpoint_negate(fixedpoint_negate(a)), a);
+}
+
+static int prop_compare(Fixedpoint a, Fixedpoint b) {
+  return fixedpoint_compare(a, b) == ref_compare(a, b)
+         && fixedpoint_compare(b, a) == -ref_compare(a, b);
+}
+
+static int prop_sort_key(Fixedpoint a, Fixedpoint b) {
+  uint8_t ka[FIXEDPOINT_SORT_KEY_LEN], kb[FIXEDPOINT_SORT_KEY_LEN];
+  fixedpoint_sort_key(a, ka);
+  fixedpoint_sort_key(b, kb);
+  int cmp = memcmp(ka, kb, FIXEDPOINT_SORT_KEY_LEN);
+  return ((cmp > 0) - (cmp < 0)) == ref_compare(a, b);
+}
+
+static int prop_accumulator(Fixedpoint a, Fixedpoint b) {
+  FixedpointAccumulator acc;
+  fixedpoint_accumulator_clear(&acc);
+  fixedpoint_accumulator_add(&acc, a);
+  fixedpoint_accumulator_add(&acc, b);
+  if (!same(fixedpoint_accumulator_value(&acc), ref_add(a, b))) return 0;
+  // adding -b gives back a exactly, even if a + b overflowed
+  fixedpoint_accumulator_add(&acc, ref_negate(b));
+  return same(fixedpoint_accumulator_value(&acc), a);
+}
+
+static int prop_lazy_sum(Fixedpoint a, Fixedpoint b) {
+  FixedpointLazySum sum;
+  fixedpoint_lazy_sum_clear(&sum);
+  fixedpoint_lazy_sum_add(&sum, a);
+  fixedpoint_lazy_sum_add(&sum, b);
+  if (!same(fixedpoint_lazy_sum_value(&sum), ref_add(a, b))) return 0;
+  fixedpoint_lazy_sum_add(&sum, ref_negate(b));
+  return same(fixedpoint_lazy_sum_value(&sum), a);
+}
+
+static int prop_format(Fixedpoint a, Fixedpoint b) {
+  char buf[FIXEDPOINT_HEX_MAX_LEN + 1], ref[64];
+  (void)b;
+  ref_format(a, ref);
+  size_t len = fixedpoint_format_as_hex_into(a, buf, sizeof(buf));
+  return len == strlen(ref) && strcmp(buf, ref) == 0;
+}
+
+static int prop_parse(Fixedpoint a, Fixedpoint b) {
+  char buf[FIXEDPOINT_HEX_MAX_LEN + 1];
+  Fixedpoint parsed;
+  (void)b;
+  size_t len = fixedpoint_format_as_hex_into(a, buf, sizeof(buf));
+  return fixedpoint_parse_hex(buf, len, &parsed) == len && same(parsed, a)
+         && same(fixedpoint_create_from_hex(buf), a);
+}
+
+typedef int (*Property)(Fixedpoint a, Fixedpoint b);
+
+typedef struct {
+  const char *name;
+  Property fn;
+} PropertyInfo;
+
+static const PropertyInfo properties[] = {
+  { "add", prop_add },
+  { "sub", prop_sub },
+  { "halve", prop_halve },
+  { "double", prop_double },
+  { "add/sub_sat", prop_add_sat },
+  { "scale_pow2", prop_scale_pow2 },
+  { "negate", prop_negate },
+  { "compare", prop_compare },
+  { "sort_key", prop_sort_key },
+  { "accumulator", prop_accumulator },
+  { "lazy_sum", prop_lazy_sum },
+  { "format", prop_format },
+  { "parse", prop_parse },
+};
+
+#define NUM_PROPERTIES ((int)(sizeof(properties) / sizeof(properties[0])))
+
+// Batch kernel properties: each block of cases also goes through the
+// array operations, and every element is checked against the model
+enum { ARRAY_ADD, ARRAY_SUB, ARRAY_HALVE, ARRAY_NEGATE, ARRAY_COMPARE, NUM_ARRAY_PROPERTIES };
+
+static const char *const array_names[NUM_ARRAY_PROPERTIES] = {
+  "array_add", "array_sub", "array_halve", "array_negate", "array_compare"
+};
+
+// Shrinking: simplify the operands one word at a time, keeping each
+// change that still makes the property fail, until nothing changes
+
+static int fails(int (*check)(Fixedpoint, Fixedpoint, const void *), const void *ctx,
+                 Fixedpoint a, Fixedpoint b) {
+  return !check(a, b, ctx);
+}
+
+static uint64_t simplify_word(uint64_t w, int how) {
+  switch (how) {
+  case 0: return 0;
+  case 1: return w >> 1;
+  case 2: return w & (w - 1);                        // clear the lowest set bit
+  case 3: return w & ~(1UL << (63 - __builtin_clzl(w))); // clear the highest set bit
+  default: return w - 1;
+  }
+}
+
+static void shrink(int (*check)(Fixedpoint, Fixedpoint, const void *), const void *ctx,
+                   Fixedpoint *a, Fixedpoint *b) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int word = 0; word < 4; word++) {
+      for (int how = 0; how < 5; how++) {
+        Fixedpoint x = *a, y = *b;
+        uint64_t *w = (word == 0) ? &x.whole : (word == 1) ? &x.frac : (word == 2) ? &y.whole : &y.frac;
+        if (*w == 0) break;
+        *w = simplify_word(*w, how);
+        // zero values are never negative
+        if (fixedpoint_is_zero(x)) x.tag = TAG_VALID_NONNEGATIVE;
+        if (fixedpoint_is_zero(y)) y.tag = TAG_VALID_NONNEGATIVE;
+        if (fails(check, ctx, x, y)) {
+          *a = x;
+          *b = y;
+          changed = 1;
+        }
+      }
+    }
+    // prefer non-negative operands
+    for (int k = 0; k < 2; k++) {
+      Fixedpoint x = *a, y = *b;
+      Fixedpoint *v = k ? &y : &x;
+      if (!fixedpoint_is_neg(*v)) continue;
+      *v = fixedpoint_negate(*v);
+      if (fails(check, ctx, x, y)) {
+        *a = x;
+        *b = y;
+        changed = 1;
+      }
+    }
+  }
+}
+
+static int check_scalar(Fixedpoint a, Fixedpoint b, const void *ctx) {
+  return ((const PropertyInfo *)ctx)->fn(a, b);
+}
+
+// One element through a batch kernel, for shrinking array failures
+static int check_array(Fixedpoint a, Fixedpoint b, const void *ctx) {
+  int which = *(const int *)ctx;
+  FixedpointArray *l = fixedpoint_array_create(1), *r = fixedpoint_array_create(1);
+  FixedpointArray *d = fixedpoint_array_create(1);
+  int8_t cmp = 0;
+  int ok;
+
+  fixedpoint_array_set(l, 0, a);
+  fixedpoint_array_set(r, 0, b);
+  switch (which) {
+  case ARRAY_ADD: fixedpoint_array_add(d, l, r, 0, 1); ok = same(fixedpoint_array_get(d, 0), ref_add(a, b)); break;
+  case ARRAY_SUB: fixedpoint_array_sub(d, l, r, 0, 1); ok = same(fixedpoint_array_get(d, 0), ref_sub(a, b)); break;
+  case ARRAY_HALVE: fixedpoint_array_halve(d, l, 0, 1); ok = same(fixedpoint_array_get(d, 0), ref_halve(a)); break;
+  case ARRAY_NEGATE: fixedpoint_array_negate(d, l, 0, 1); ok = same(fixedpoint_array_get(d, 0), ref_negate(a)); break;
+  default: fixedpoint_array_compare(&cmp, l, r, 0, 1); ok = cmp == ref_compare(a, b); break;
+  }
+  fixedpoint_array_destroy(l);
+  fixedpoint_array_destroy(r);
+  fixedpoint_array_destroy(d);
+  return ok;
+}
+
+// Failure counts and reports, shared by the threads
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t failures[NUM_PROPERTIES + NUM_ARRAY_PROPERTIES];
+static uint64_t seed;
+
+static void print_value(const char *label, Fixedpoint val) {
+  char buf[FIXEDPOINT_HEX_MAX_LEN + 1];
+  fixedpoint_format_as_hex_into(val, buf, sizeof(buf));
+  printf("    %s = %s (whole %016" PRIx64 ", frac %016" PRIx64 ", tag %d)\n",
+         label, buf, val.whole, val.frac, (int)val.tag);
+}
+
+static void report(int prop, const char *name, uint64_t index, Fixedpoint a, Fixedpoint b,
+                   int (*check)(Fixedpoint, Fixedpoint, const void *), const void *ctx) {
+  pthread_mutex_lock(&report_lock);
+  if (failures[prop]++ < MAX_REPORTS) {
+    Fixedpoint sa = a, sb = b;
+    shrink(check, ctx, &sa, &sb);
+    printf("FAILED %s: seed %" PRIu64 ", case %" PRIu64 " (rerun with -s %" PRIu64 " -c %" PRIu64 " -n 1)\n",
+           name, seed, index, seed, index);
+    print_value("a", a);
+    print_value("b", b);
+    printf("  shrunk to:\n");
+    print_value("a", sa);
+    print_value("b", sb);
+    fflush(stdout);
+  }
+  pthread_mutex_unlock(&report_lock);
+}
+
+typedef struct {
+  uint64_t first, count; // cases first .. first+count-1
+} Work;
+
+static void *worker(void *arg) {
+  const Work *work = arg;
+  FixedpointArray *left = fixedpoint_array_create(BLOCK), *right = fixedpoint_array_create(BLOCK);
+  FixedpointArray *res[NUM_ARRAY_PROPERTIES - 1];
+  int8_t cmp[BLOCK];
+  if (!left || !right) abort();
+  for (int k = 0; k < NUM_ARRAY_PROPERTIES - 1; k++) {
+    if (!(res[k] = fixedpoint_array_create(BLOCK))) abort();
+  }
+
+  for (uint64_t start = 0; start < work->count; start += BLOCK) {
+    uint64_t n = (work->count - start < BLOCK) ? work->count - start : BLOCK;
+    uint64_t base = work->first + start;
+
+    for (uint64_t i = 0; i < n; i++) {
+      Fixedpoint a, b;
+      make_case(seed, base + i, &a, &b);
+      fixedpoint_array_set(left, i, a);
+      fixedpoint_array_set(right, i, b);
+      for (int p = 0; p < NUM_PROPERTIES; p++) {
+        if (!properties[p].fn(a, b)) {
+          report(p, properties[p].name, base + i, a, b, check_scalar, &properties[p]);
+        }
+      }
+    }
+
+    fixedpoint_array_add(res[ARRAY_ADD], left, right, 0, n);
+    fixedpoint_array_sub(res[ARRAY_SUB], left, right, 0, n);
+    fixedpoint_array_halve(res[ARRAY_HALVE], left, 0, n);
+    fixedpoint_array_negate(res[ARRAY_NEGATE], left, 0, n);
+    fixedpoint_array_compare(cmp, left, right, 0, n);
+    for (uint64_t i = 0; i < n; i++) {
+      Fixedpoint a = fixedpoint_array_get(left, i), b = fixedpoint_array_get(right, i);
+      Fixedpoint expected[] = { ref_add(a, b), ref_sub(a, b), ref_halve(a), ref_negate(a) };
+      for (int k = 0; k < NUM_ARRAY_PROPERTIES; k++) {
+        int ok = (k == ARRAY_COMPARE) ? cmp[i] == ref_compare(a, b)
+                                      : same(fixedpoint_array_get(res[k], i), expected[k]);
+        if (!ok) {
+          report(NUM_PROPERTIES + k, array_names[k], base + i, a, b, check_array, &k);
+        }
+      }
+    }
+  }
+
+  fixedpoint_array_destroy(left);
+  fixedpoint_array_destroy(right);
+  for (int k = 0; k < NUM_ARRAY_PROPERTIES - 1; k++) fixedpoint_array_destroy(res[k]);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  uint64_t num_cases = 10000000, first = 0;
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  seed = (uint64_t)time(NULL);
+  while ((opt = getopt(argc, argv, "n:j:s:c:")) != -1) {
+    switch (opt) {
+    case 'n': num_cases = strtoull(optarg, NULL, 0); break;
+    case 'j': nthreads = atol(optarg); break;
+    case 's': seed = strtoull(optarg, NULL, 0); break;
+    case 'c': first = strtoull(optarg, NULL, 0); break;
+    default:
+      fprintf(stderr, "Usage: %s [-n cases] [-j threads] [-s seed] [-c first_case]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (nthreads < 1) nthreads = 1;
+
+  printf("seed %" PRIu64 ", cases %" PRIu64 "..%" PRIu64 ", %ld threads, instruction set %s\n",
+         seed, first, first + num_cases - 1, nthreads, fixedpoint_isa_name(fixedpoint_isa()));
+  fflush(stdout);
+
+  // split the cases into one contiguous range per thread
+  pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+  Work *work = malloc(nthreads * sizeof(Work));
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (long t = 0; t < nthreads; t++) {
+    work[t].first = first + num_cases / nthreads * t;
+    work[t].count = (t == nthreads - 1) ? first + num_cases - work[t].first : num_cases / nthreads;
+    if (pthread_create(&threads[t], NULL, worker, &work[t]) != 0) {
+      perror("pthread_create");
+      return 2;
+    }
+  }
+  for (long t = 0; t < nthreads; t++) pthread_join(threads[t], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  free(threads);
+  free(work);
+
+  uint64_t total = 0;
+  for (int p = 0; p < NUM_PROPERTIES + NUM_ARRAY_PROPERTIES; p++) {
+    const char *name = (p < NUM_PROPERTIES) ? properties[p].name : array_names[p - NUM_PROPERTIES];
+    printf("%-14s %" PRIu64 " failure(s)\n", name, failures[p]);
+    total += failures[p];
+  }
+  double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+  printf("%s: %" PRIu64 " cases in %.1f s (%.1f M cases/s)\n", total ? "FAILED" : "passed",
+         num_cases, secs, num_cases / secs / 1e6);
+  return total != 0;
+}
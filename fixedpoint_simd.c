@@ -0,0 +1,353 @@
+// Batch kernels over FixedpointArray columns, and the 64x64 partial
+// product kernel behind fixedpoint_mul, for each instruction set level
+// the dispatcher (fixedpoint_dispatch.c) can select.
+//
+// The element-wise loops (negate, halve, compare, and add/sub up to
+// SSE4.2) are written once as always-inline functions and instantiated
+// with target attributes, so the compiler vectorizes each copy for its
+// instruction set (64-bit compares need at least SSE4.2).  Add/sub also
+// has hand-written AVX2 (4 lanes) and AVX-512 (8 lanes) versions.  All
+// versions compute exactly what the scalar functions in fixedpoint.c do.
+//
+// The vector add/sub kernels follow the same steps as fp_addsub_words:
+// convert both operands to two's complement using per-lane sign masks,
+// add the frac words, propagate the carry into the whole words with an
+// unsigned compare, and derive the result tag from the sign extension
+// words.
+//
+// Since only the functions themselves carry target attributes, the rest
+// of the library doesn't need to be built for AVX2/AVX-512; the
+// dispatcher only selects kernels that the CPU supports.
+
+#include <string.h>
+#include "fixedpoint_internal.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+// The loops take the column pointers as separate arguments: if they went
+// through the FixedpointArray structs, the compiler would have to assume
+// that storing an element may change the pointers, and wouldn't vectorize.
+// Element i of the result only depends on element i of the operands, so
+// there are no loop-carried dependencies even when the destination is
+// also a source; "ivdep" tells the compiler so, rather than having it emit
+// runtime overlap checks for every pair of columns.
+
+ALWAYS_INLINE void addsub_loop(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                               const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                               const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                               size_t n, unsigned flip) {
+#pragma GCC ivdep
+  for (size_t i = 0; i < n; i++) {
+    fp_addsub_words(lw[i], lf[i], lt[i], rw[i], rf[i], rt[i], flip, &dw[i], &df[i], &dt[i]);
+  }
+}
+
+ALWAYS_INLINE void negate_loop(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                               const uint64_t *sw, const uint64_t *sf, const uint8_t *st,
+                               size_t n) {
+#pragma GCC ivdep
+  for (size_t i = 0; i < n; i++) {
+    uint64_t w = sw[i], f = sf[i];
+    uint8_t t = st[i];
+    // only valid, nonzero values change sign
+    dw[i] = w;
+    df[i] = f;
+    dt[i] = t ^ ((t <= TAG_VALID_NEGATIVE) & ((w | f) != 0));
+  }
+}
+
+ALWAYS_INLINE void halve_loop(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                              const uint64_t *sw, const uint64_t *sf, const uint8_t *st,
+                              size_t n) {
+#pragma GCC ivdep
+  for (size_t i = 0; i < n; i++) {
+    uint64_t w = sw[i], f = sf[i];
+    uint8_t t = st[i];
+    // an odd fractional part loses its lowest bit
+    uint8_t underflow = (t == TAG_VALID_NONNEGATIVE) ? TAG_POS_UNDERFLOW : TAG_NEG_UNDERFLOW;
+    dw[i] = w >> 1;
+    df[i] = (f >> 1) | (w << 63);
+    dt[i] = (f & 1) ? underflow : t;
+  }
+}
+
+ALWAYS_INLINE void compare_loop(int8_t *out,
+                                const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                                const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                                size_t n) {
+#pragma GCC ivdep
+  for (size_t i = 0; i < n; i++) {
+    out[i] = (int8_t)fp_compare_words(lw[i], lf[i], lt[i], rw[i], rf[i], rt[i]);
+  }
+}
+
+// Full 256-bit product of two 128-bit magnitudes (a1, a0) * (b1, b0),
+// least significant word first
+static void mul_generic(uint64_t a1, uint64_t a0, uint64_t b1, uint64_t b0, uint64_t p[4]) {
+  fp_u128 ll = (fp_u128)a0 * b0;
+  fp_u128 lh = (fp_u128)a0 * b1;
+  fp_u128 hl = (fp_u128)a1 * b0;
+  fp_u128 hh = (fp_u128)a1 * b1;
+  // sum of the middle column, can't exceed 3 * (2^64 - 1)
+  fp_u128 mid = (ll >> 64) + (uint64_t)lh + (uint64_t)hl;
+  // upper half of the product, can't exceed 2^128 - 1
+  fp_u128 high = hh + (lh >> 64) + (hl >> 64) + (mid >> 64);
+  p[0] = (uint64_t)ll;
+  p[1] = (uint64_t)mid;
+  p[2] = (uint64_t)high;
+  p[3] = (uint64_t)(high >> 64);
+}
+
+// Instantiate the element-wise loops for one instruction set
+#define DEFINE_LOOP_KERNELS(isa, attr) \
+  attr static void addsub_##isa(uint64_t *dw, uint64_t *df, uint8_t *dt, \
+                                const uint64_t *lw, const uint64_t *lf, const uint8_t *lt, \
+                                const uint64_t *rw, const uint64_t *rf, const uint8_t *rt, \
+                                size_t n, unsigned flip) { \
+    addsub_loop(dw, df, dt, lw, lf, lt, rw, rf, rt, n, flip); \
+  } \
+  attr static void negate_##isa(uint64_t *dw, uint64_t *df, uint8_t *dt, \
+                                const uint64_t *sw, const uint64_t *sf, const uint8_t *st, \
+                                size_t n) { \
+    negate_loop(dw, df, dt, sw, sf, st, n); \
+  } \
+  attr static void halve_##isa(uint64_t *dw, uint64_t *df, uint8_t *dt, \
+                               const uint64_t *sw, const uint64_t *sf, const uint8_t *st, \
+                               size_t n) { \
+    halve_loop(dw, df, dt, sw, sf, st, n); \
+  } \
+  attr static void compare_##isa(int8_t *out, \
+                                 const uint64_t *lw, const uint64_t *lf, const uint8_t *lt, \
+                                 const uint64_t *rw, const uint64_t *rf, const uint8_t *rt, \
+                                 size_t n) { \
+    compare_loop(out, lw, lf, lt, rw, rf, rt, n); \
+  }
+
+DEFINE_LOOP_KERNELS(scalar, )
+
+void fp_addsub_scalar(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                      const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                      const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                      size_t n, unsigned flip) {
+  addsub_scalar(dw, df, dt, lw, lf, lt, rw, rf, rt, n, flip);
+}
+
+const FpKernels fp_kernels_scalar = {
+  "scalar", fp_addsub_scalar, negate_scalar, halve_scalar, compare_scalar, mul_generic
+};
+
+#if defined(__x86_64__)
+
+DEFINE_LOOP_KERNELS(sse42, __attribute__((target("sse4.2"))))
+DEFINE_LOOP_KERNELS(avx2, __attribute__((target("avx2"))))
+DEFINE_LOOP_KERNELS(avx512, __attribute__((target("avx512f"))))
+
+// Unsigned 64-bit a < b, as a lane mask.  AVX2 only has a signed compare,
+// so flip the sign bits first.
+__attribute__((target("avx2")))
+static inline __m256i ult_epu64(__m256i a, __m256i b) {
+  const __m256i bias = _mm256_set1_epi64x((long long)0x8000000000000000UL);
+  return _mm256_cmpgt_epi64(_mm256_xor_si256(b, bias), _mm256_xor_si256(a, bias));
+}
+
+// Load 4 tag bytes, widened to 64-bit lanes
+__attribute__((target("avx2")))
+static inline __m256i load_tags4(const uint8_t *t) {
+  int32_t bytes;
+  memcpy(&bytes, t, sizeof(bytes));
+  return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+}
+
+// Store the low byte of each 64-bit lane as 4 tag bytes
+__attribute__((target("avx2")))
+static inline void store_tags4(uint8_t *t, __m256i tags) {
+  // gather bytes 0 and 8 of each 128-bit half into its low two bytes
+  const __m256i ctrl = _mm256_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1,
+                                        -1, -1, -1, -1, -1, -1, -1, -1,
+                                        0, 8, -1, -1, -1, -1, -1, -1,
+                                        -1, -1, -1, -1, -1, -1, -1, -1);
+  __m256i packed = _mm256_shuffle_epi8(tags, ctrl);
+  uint32_t lo = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+  uint32_t hi = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+  uint32_t bytes = (lo & 0xffff) | (hi << 16);
+  memcpy(t, &bytes, sizeof(bytes));
+}
+
+__attribute__((target("avx2")))
+void fp_addsub_avx2(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                    const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                    const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                    size_t n, unsigned flip) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i neg_tag = _mm256_set1_epi64x(TAG_VALID_NEGATIVE);
+  // with flip, a right operand counts as negative if its tag is non-negative
+  const __m256i rneg_tag = _mm256_set1_epi64x(flip ? TAG_VALID_NONNEGATIVE : TAG_VALID_NEGATIVE);
+  const __m256i minus_one = _mm256_set1_epi64x(-1);
+  const __m256i minus_two = _mm256_set1_epi64x(-2);
+  const __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    __m256i vlw = _mm256_loadu_si256((const __m256i *)(lw + i));
+    __m256i vlf = _mm256_loadu_si256((const __m256i *)(lf + i));
+    __m256i vrw = _mm256_loadu_si256((const __m256i *)(rw + i));
+    __m256i vrf = _mm256_loadu_si256((const __m256i *)(rf + i));
+
+    // sign masks (all ones for a negative, nonzero operand)
+    __m256i lzero = _mm256_cmpeq_epi64(_mm256_or_si256(vlw, vlf), zero);
+    __m256i rzero = _mm256_cmpeq_epi64(_mm256_or_si256(vrw, vrf), zero);
+    __m256i ln = _mm256_andnot_si256(lzero, _mm256_cmpeq_epi64(load_tags4(lt + i), neg_tag));
+    __m256i rn = _mm256_andnot_si256(rzero, _mm256_cmpeq_epi64(load_tags4(rt + i), rneg_tag));
+
+    // two's complement: -(w, f) = (~w + (f == 0), -f); subtracting an
+    // all-ones mask adds one
+    __m256i lxf = _mm256_sub_epi64(_mm256_xor_si256(vlf, ln), ln);
+    __m256i lxw = _mm256_sub_epi64(_mm256_xor_si256(vlw, ln),
+                                   _mm256_and_si256(ln, _mm256_cmpeq_epi64(vlf, zero)));
+    __m256i rxf = _mm256_sub_epi64(_mm256_xor_si256(vrf, rn), rn);
+    __m256i rxw = _mm256_sub_epi64(_mm256_xor_si256(vrw, rn),
+                                   _mm256_and_si256(rn, _mm256_cmpeq_epi64(vrf, zero)));
+
+    // 128-bit add with the carries as lane masks
+    __m256i sf = _mm256_add_epi64(lxf, rxf);
+    __m256i c1 = ult_epu64(sf, lxf);
+    __m256i sw = _mm256_sub_epi64(_mm256_add_epi64(lxw, rxw), c1);
+    __m256i c2 = _mm256_or_si256(ult_epu64(sw, lxw),
+                                 _mm256_and_si256(_mm256_cmpeq_epi64(sw, lxw), c1));
+    // sign extension word of the sum, -2..1
+    __m256i hi = _mm256_sub_epi64(_mm256_add_epi64(ln, rn), c2);
+    __m256i sum_zero = _mm256_cmpeq_epi64(_mm256_or_si256(sw, sf), zero);
+    hi = _mm256_add_epi64(hi, _mm256_and_si256(_mm256_cmpeq_epi64(hi, minus_one), sum_zero));
+
+    // back to a magnitude
+    __m256i m = _mm256_cmpgt_epi64(zero, hi);
+    __m256i f = _mm256_sub_epi64(_mm256_xor_si256(sf, m), m);
+    __m256i w = _mm256_sub_epi64(_mm256_xor_si256(sw, m),
+                                 _mm256_and_si256(m, _mm256_cmpeq_epi64(sf, zero)));
+    __m256i tag = _mm256_or_si256(
+        _mm256_and_si256(_mm256_cmpeq_epi64(hi, one), _mm256_set1_epi64x(TAG_POS_OVERFLOW)),
+        _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi64(hi, minus_one), _mm256_set1_epi64x(TAG_VALID_NEGATIVE)),
+            _mm256_and_si256(_mm256_cmpeq_epi64(hi, minus_two), _mm256_set1_epi64x(TAG_NEG_OVERFLOW))));
+
+    _mm256_storeu_si256((__m256i *)(dw + i), w);
+    _mm256_storeu_si256((__m256i *)(df + i), f);
+    store_tags4(dt + i, tag);
+  }
+
+  addsub_avx2(dw + i, df + i, dt + i, lw + i, lf + i, lt + i,
+              rw + i, rf + i, rt + i, n - i, flip);
+}
+
+__attribute__((target("avx512f")))
+void fp_addsub_avx512(uint64_t *dw, uint64_t *df, uint8_t *dt,
+                      const uint64_t *lw, const uint64_t *lf, const uint8_t *lt,
+                      const uint64_t *rw, const uint64_t *rf, const uint8_t *rt,
+                      size_t n, unsigned flip) {
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i ones = _mm512_set1_epi64(-1);
+  const __m512i one = _mm512_set1_epi64(1);
+  const __m512i neg_tag = _mm512_set1_epi64(TAG_VALID_NEGATIVE);
+  const __m512i rneg_tag = _mm512_set1_epi64(flip ? TAG_VALID_NONNEGATIVE : TAG_VALID_NEGATIVE);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m512i vlw = _mm512_loadu_si512(lw + i);
+    __m512i vlf = _mm512_loadu_si512(lf + i);
+    __m512i vrw = _mm512_loadu_si512(rw + i);
+    __m512i vrf = _mm512_loadu_si512(rf + i);
+    __m512i vlt = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)(lt + i)));
+    __m512i vrt = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)(rt + i)));
+
+    // sign masks (set for a negative, nonzero operand)
+    __mmask8 ln = _mm512_cmpeq_epi64_mask(vlt, neg_tag)
+                  & _mm512_cmpneq_epi64_mask(_mm512_or_si512(vlw, vlf), zero);
+    __mmask8 rn = _mm512_cmpeq_epi64_mask(vrt, rneg_tag)
+                  & _mm512_cmpneq_epi64_mask(_mm512_or_si512(vrw, vrf), zero);
+
+    // two's complement of the negative lanes: -(w, f) = (~w + (f == 0), -f)
+    __m512i lxf = _mm512_mask_sub_epi64(vlf, ln, zero, vlf);
+    __m512i lxw = _mm512_mask_xor_epi64(vlw, ln, vlw, ones);
+    lxw = _mm512_mask_add_epi64(lxw, ln & _mm512_cmpeq_epi64_mask(vlf, zero), lxw, one);
+    __m512i rxf = _mm512_mask_sub_epi64(vrf, rn, zero, vrf);
+    __m512i rxw = _mm512_mask_xor_epi64(vrw, rn, vrw, ones);
+    rxw = _mm512_mask_add_epi64(rxw, rn & _mm512_cmpeq_epi64_mask(vrf, zero), rxw, one);
+
+    // 128-bit add with the carries as lane masks
+    __m512i sf = _mm512_add_epi64(lxf, rxf);
+    __mmask8 c1 = _mm512_cmplt_epu64_mask(sf, lxf);
+    __m512i sw = _mm512_add_epi64(lxw, rxw);
+    sw = _mm512_mask_add_epi64(sw, c1, sw, one);
+    __mmask8 c2 = _mm512_cmplt_epu64_mask(sw, lxw) | (_mm512_cmpeq_epi64_mask(sw, lxw) & c1);
+
+    // the sign extension word of the sum is c2 - ln - rn; classify it
+    // directly from the masks
+    __mmask8 pos_overflow = ~ln & ~rn & c2;
+    __mmask8 neg = ((ln ^ rn) & ~c2) | (ln & rn & c2);
+    __mmask8 neg_overflow = ln & rn & ~c2;
+    // a sum of exactly -2^128 is a negative overflow
+    __mmask8 sum_zero = _mm512_cmpeq_epi64_mask(_mm512_or_si512(sw, sf), zero);
+    neg_overflow |= neg & sum_zero;
+    neg &= ~sum_zero;
+
+    // back to a magnitude
+    __mmask8 m = neg | neg_overflow;
+    __m512i f = _mm512_mask_sub_epi64(sf, m, zero, sf);
+    __m512i w = _mm512_mask_xor_epi64(sw, m, sw, ones);
+    w = _mm512_mask_add_epi64(w, m & _mm512_cmpeq_epi64_mask(sf, zero), w, one);
+    __m512i tag = _mm512_maskz_mov_epi64(pos_overflow, _mm512_set1_epi64(TAG_POS_OVERFLOW));
+    tag = _mm512_mask_mov_epi64(tag, neg, _mm512_set1_epi64(TAG_VALID_NEGATIVE));
+    tag = _mm512_mask_mov_epi64(tag, neg_overflow, _mm512_set1_epi64(TAG_NEG_OVERFLOW));
+
+    _mm512_storeu_si512(dw + i, w);
+    _mm512_storeu_si512(df + i, f);
+    _mm_storel_epi64((__m128i *)(dt + i), _mm512_cvtepi64_epi8(tag));
+  }
+
+  addsub_avx512(dw + i, df + i, dt + i, lw + i, lf + i, lt + i,
+                rw + i, rf + i, rt + i, n - i, flip);
+}
+
+// 256-bit product using mulx for the partial products, which leaves the
+// flags alone, so the two carry chains summing the middle columns can use
+// adcx/adox
+__attribute__((target("bmi2,adx")))
+void fp_mul_bmi2(uint64_t a1, uint64_t a0, uint64_t b1, uint64_t b0, uint64_t p[4]) {
+  unsigned long long ll_hi, lh_hi, hl_hi, hh_hi;
+  unsigned long long ll = _mulx_u64(a0, b0, &ll_hi);
+  unsigned long long lh = _mulx_u64(a0, b1, &lh_hi);
+  unsigned long long hl = _mulx_u64(a1, b0, &hl_hi);
+  unsigned long long hh = _mulx_u64(a1, b1, &hh_hi);
+  unsigned long long p1, p2, p3, q1, q2, q3;
+
+  // (ll_hi + lh) carried into hh, and hl + lh_hi, as two chains
+  unsigned char c = _addcarryx_u64(0, ll_hi, lh, &p1);
+  c = _addcarryx_u64(c, hh, lh_hi, &p2);
+  _addcarryx_u64(c, hh_hi, 0, &p3);
+  c = _addcarryx_u64(0, p1, hl, &q1);
+  c = _addcarryx_u64(c, p2, hl_hi, &q2);
+  _addcarryx_u64(c, p3, 0, &q3);
+
+  p[0] = ll;
+  p[1] = q1;
+  p[2] = q2;
+  p[3] = q3;
+}
+
+const FpKernels fp_kernels_sse42 = {
+  "sse4.2", addsub_sse42, negate_sse42, halve_sse42, compare_sse42, mul_generic
+};
+
+const FpKernels fp_kernels_avx2 = {
+  "avx2", fp_addsub_avx2, negate_avx2, halve_avx2, compare_avx2, mul_generic
+};
+
+const FpKernels fp_kernels_avx512 = {
+  "avx512", fp_addsub_avx512, negate_avx512, halve_avx512, compare_avx512, mul_generic
+};
+
+#endif // __x86_64__
@@ -0,0 +1,350 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixedpoint_sort.h"
+#include "fixedpoint_internal.h"
+
+// The keys are partitioned DIGIT_BITS bits at a time, most significant
+// first.  A key is 131 bits: the 128 bits of the magnitude words and the
+// 3-bit prefix (0 .. 7).
+#define DIGIT_BITS 11
+#define BUCKETS (1 << DIGIT_BITS)
+
+// Ranges of at most this many elements are insertion sorted
+#define INSERTION_MAX 32
+
+// Minimum number of elements sorted by each thread
+#define MIN_CHUNK (1 << 16)
+
+// The sort key of a value, as its prefix byte and the two 64-bit words
+// that follow it
+typedef struct {
+  uint64_t whole, frac;
+  unsigned prefix;
+} SortKey;
+
+static inline SortKey sort_key(uint64_t whole, uint64_t frac, unsigned tag) {
+  SortKey key;
+  unsigned neg = (tag == TAG_VALID_NEGATIVE) & ((whole | frac) != 0);
+  // inverting the magnitude of a negative value reverses its order
+  uint64_t m = -(uint64_t)neg;
+  key.whole = whole ^ m;
+  key.frac = frac ^ m;
+  key.prefix = (tag <= TAG_VALID_NEGATIVE) ? !neg : tag;
+  return key;
+}
+
+void fixedpoint_sort_key(Fixedpoint val, uint8_t key[FIXEDPOINT_SORT_KEY_LEN]) {
+  SortKey k = sort_key(val.whole, val.frac, val.tag);
+  key[0] = (uint8_t)k.prefix;
+  for (int i = 0; i < 8; i++) {
+    key[1 + i] = (uint8_t)(k.whole >> (56 - 8 * i));
+    key[9 + i] = (uint8_t)(k.frac >> (56 - 8 * i));
+  }
+}
+
+// An element being sorted: its key, and its original tag, which together
+// give back the element (a zero with a negative tag has the key of zero,
+// so the key alone isn't enough)
+typedef struct {
+  uint64_t lo;   // the fractional word of the key
+  uint64_t hi;   // the whole word of the key
+  uint64_t meta; // bits 0-2: the prefix; bits 8-15: the tag
+} SortRecord;
+
+static inline SortRecord make_record(uint64_t whole, uint64_t frac, unsigned tag) {
+  SortKey key = sort_key(whole, frac, tag);
+  SortRecord rec = { key.frac, key.whole, key.prefix | ((uint64_t)tag << 8) };
+  return rec;
+}
+
+// The DIGIT_BITS bits of a record's key starting at bit shift
+static inline unsigned record_digit(const SortRecord *rec, int shift) {
+  fp_u128 bits = (shift < 64) ? (((fp_u128)rec->hi << 64) | rec->lo) >> shift
+                              : (((fp_u128)rec->meta << 64) | rec->hi) >> (shift - 64);
+  return (unsigned)bits & (BUCKETS - 1);
+}
+
+// Whether record a sorts before record b
+static inline int record_less(const SortRecord *a, const SortRecord *b) {
+  unsigned pa = a->meta & 7, pb = b->meta & 7;
+  return (pa < pb) | ((pa == pb) & ((a->hi < b->hi) | ((a->hi == b->hi) & (a->lo < b->lo))));
+}
+
+// The bits in which some of a set of records differ, as the OR of
+// (record ^ first record) over the set
+typedef struct {
+  uint64_t lo, hi, meta;
+} KeyDiff;
+
+static inline void key_diff_add(KeyDiff *diff, const SortRecord *rec, const SortRecord *first) {
+  diff->lo |= rec->lo ^ first->lo;
+  diff->hi |= rec->hi ^ first->hi;
+  diff->meta |= (rec->meta ^ first->meta) & 7;
+}
+
+// The shift of the bits-bit digit to partition records with the given
+// difference bits on: the one ending at the most significant bit in which
+// they differ, or -1 if their keys are all equal
+static inline int digit_shift(KeyDiff diff, int bits) {
+  int bit = diff.meta ? 128 + 63 - __builtin_clzll(diff.meta)
+            : diff.hi ? 64 + 63 - __builtin_clzll(diff.hi)
+            : diff.lo ? 63 - __builtin_clzll(diff.lo) : -1;
+  return (bit < 0) ? -1 : (bit >= bits - 1) ? bit - (bits - 1) : 0;
+}
+
+// The top-level partition splits the records by prefix (the sign of a
+// valid value, or the tag of a non-valid one) and then by the top
+// DIGIT_BITS bits in which the keys with that prefix differ, so that
+// records of different signs don't waste a partition step
+#define NUM_PREFIXES 8
+#define TOP_BUCKETS (NUM_PREFIXES * BUCKETS)
+
+// The state shared by the threads of a sort
+typedef struct {
+  FixedpointArray *arr;
+  size_t start;
+  SortRecord *src, *dst;           // records before and after the top-level partition
+  int shift[NUM_PREFIXES];         // per prefix: the shift of the top-level digit
+  unsigned mask[NUM_PREFIXES];     // its mask (0 if the keys are all equal)
+  unsigned base[NUM_PREFIXES];     // its first top-level bucket
+  unsigned num_buckets;            // number of top-level buckets
+  size_t ends[TOP_BUCKETS];        // after the partition: the end of each bucket in dst
+} Sorter;
+
+// A range of records handled by one thread: first a range of elements
+// (begin .. end-1), then a range of top-level buckets (bucket_begin ..
+// bucket_end-1)
+typedef struct {
+  Sorter *sorter;
+  size_t begin, end;
+  unsigned bucket_begin, bucket_end;
+  unsigned seen;                       // bit p: a record with prefix p was seen
+  uint64_t or_hi[NUM_PREFIXES], or_lo[NUM_PREFIXES];   // OR of the keys, per prefix
+  uint64_t and_hi[NUM_PREFIXES], and_lo[NUM_PREFIXES]; // AND of the keys, per prefix
+  size_t counts[TOP_BUCKETS];          // records per top-level bucket, then offsets
+  pthread_t thread;
+  int thread_started;
+} Chunk;
+
+static inline unsigned top_bucket(const Sorter *s, const SortRecord *rec) {
+  unsigned p = rec->meta & 7;
+  fp_u128 key = ((fp_u128)rec->hi << 64) | rec->lo;
+  return s->base[p] + ((unsigned)(key >> s->shift[p]) & s->mask[p]);
+}
+
+// Write n sorted records back to the array, as elements offset ..
+// offset+n-1 of the range being sorted
+static void decode_records(const Sorter *s, const SortRecord *recs, size_t offset, size_t n) {
+  FixedpointArray *arr = s->arr;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t m = -(uint64_t)((recs[i].meta & 7) == 0);
+    size_t j = s->start + offset + i;
+    arr->whole[j] = recs[i].hi ^ m;
+    arr->frac[j] = recs[i].lo ^ m;
+    arr->tag[j] = (uint8_t)(recs[i].meta >> 8);
+  }
+}
+
+// Sort the n records in src into elements offset .. offset+n-1 of the
+// range being sorted, using dst (of the same size) as scratch space.  Each
+// partition step moves the records between src and dst, which keeps the
+// sort stable.  Smaller ranges are partitioned on narrower digits, so that
+// the cost of the counts doesn't outweigh that of the records.
+static void sort_records(const Sorter *s, SortRecord *src, SortRecord *dst, size_t offset,
+                         size_t n) {
+  if (n <= INSERTION_MAX) {
+    for (size_t i = 1; i < n; i++) {
+      SortRecord rec = src[i];
+      size_t j = i;
+      for (; j > 0 && record_less(&rec, &src[j - 1]); j--) src[j] = src[j - 1];
+      src[j] = rec;
+    }
+    decode_records(s, src, offset, n);
+    return;
+  }
+
+  // skip the bits in which all the keys are the same
+  KeyDiff diff = { 0, 0, 0 };
+  for (size_t i = 1; i < n; i++) key_diff_add(&diff, &src[i], &src[0]);
+  int bits = (n >= 4096) ? DIGIT_BITS : (n >= 512) ? 8 : 5;
+  int shift = digit_shift(diff, bits);
+  if (shift < 0) {
+    decode_records(s, src, offset, n);
+    return;
+  }
+
+  unsigned buckets = 1U << bits;
+  size_t ends[BUCKETS];
+  memset(ends, 0, buckets * sizeof(size_t));
+  for (size_t i = 0; i < n; i++) ends[record_digit(&src[i], shift) & (buckets - 1)]++;
+  size_t pos = 0;
+  for (unsigned b = 0; b < buckets; b++) {
+    size_t count = ends[b];
+    ends[b] = pos;
+    pos += count;
+  }
+  for (size_t i = 0; i < n; i++) dst[ends[record_digit(&src[i], shift) & (buckets - 1)]++] = src[i];
+
+  size_t begin = 0;
+  for (unsigned b = 0; b < buckets; b++) {
+    if (ends[b] > begin) sort_records(s, dst + begin, src + begin, offset + begin, ends[b] - begin);
+    begin = ends[b];
+  }
+}
+
+// Build the chunk's records, finding the bits in which those with each
+// prefix differ
+static void *build_records(void *arg) {
+  Chunk *chunk = arg;
+  Sorter *s = chunk->sorter;
+  const FixedpointArray *arr = s->arr;
+  for (int p = 0; p < NUM_PREFIXES; p++) {
+    chunk->or_hi[p] = chunk->or_lo[p] = 0;
+    chunk->and_hi[p] = chunk->and_lo[p] = ~(uint64_t)0;
+  }
+  unsigned seen = 0;
+  for (size_t i = chunk->begin; i < chunk->end; i++) {
+    size_t j = s->start + i;
+    SortRecord rec = make_record(arr->whole[j], arr->frac[j], arr->tag[j]);
+    unsigned p = rec.meta & 7;
+    s->src[i] = rec;
+    seen |= 1U << p;
+    chunk->or_hi[p] |= rec.hi;
+    chunk->or_lo[p] |= rec.lo;
+    chunk->and_hi[p] &= rec.hi;
+    chunk->and_lo[p] &= rec.lo;
+  }
+  chunk->seen = seen;
+  return NULL;
+}
+
+// Count the records of the chunk in each top-level bucket
+static void *count_buckets(void *arg) {
+  Chunk *chunk = arg;
+  Sorter *s = chunk->sorter;
+  memset(chunk->counts, 0, s->num_buckets * sizeof(size_t));
+  for (size_t i = chunk->begin; i < chunk->end; i++) chunk->counts[top_bucket(s, &s->src[i])]++;
+  return NULL;
+}
+
+// Move the chunk's records to their top-level buckets in dst; counts
+// holds the chunk's first position in each bucket
+static void *scatter(void *arg) {
+  Chunk *chunk = arg;
+  Sorter *s = chunk->sorter;
+  const SortRecord *src = s->src;
+  SortRecord *dst = s->dst;
+  for (size_t i = chunk->begin; i < chunk->end; i++) {
+    dst[chunk->counts[top_bucket(s, &src[i])]++] = src[i];
+  }
+  return NULL;
+}
+
+// Sort the chunk's top-level buckets
+static void *sort_buckets(void *arg) {
+  Chunk *chunk = arg;
+  Sorter *s = chunk->sorter;
+  for (unsigned b = chunk->bucket_begin; b < chunk->bucket_end; b++) {
+    size_t begin = (b > 0) ? s->ends[b - 1] : 0;
+    if (s->ends[b] > begin) {
+      sort_records(s, s->dst + begin, s->src + begin, begin, s->ends[b] - begin);
+    }
+  }
+  return NULL;
+}
+
+static void run_chunks(Chunk *chunks, int n, void *(*fn)(void *)) {
+  for (int i = 1; i < n; i++) {
+    chunks[i].thread_started = pthread_create(&chunks[i].thread, NULL, fn, &chunks[i]) == 0;
+  }
+  fn(&chunks[0]);
+  for (int i = 1; i < n; i++) {
+    // if a thread couldn't be started, do its work here instead
+    if (chunks[i].thread_started) pthread_join(chunks[i].thread, NULL);
+    else fn(&chunks[i]);
+  }
+}
+
+int fixedpoint_array_sort(FixedpointArray *arr, size_t start, size_t n, int nthreads) {
+  if (n < 2) return 1;
+  if (nthreads <= 0) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpus > 0) ? (int)ncpus : 1;
+  }
+  if ((size_t)nthreads > n / MIN_CHUNK) {
+    nthreads = (n / MIN_CHUNK > 0) ? (int)(n / MIN_CHUNK) : 1;
+  }
+
+  // the keys are computed once, into records that are sorted back and
+  // forth between two buffers
+  SortRecord *records = malloc(2 * n * sizeof(SortRecord));
+  Chunk *chunks = calloc(nthreads, sizeof(Chunk));
+  Sorter *s = malloc(sizeof(Sorter));
+  if (!records || !chunks || !s) {
+    free(records);
+    free(chunks);
+    free(s);
+    return 0;
+  }
+  s->arr = arr;
+  s->start = start;
+  s->src = records;
+  s->dst = records + n;
+  for (int c = 0; c < nthreads; c++) {
+    chunks[c].sorter = s;
+    chunks[c].begin = n / nthreads * c;
+    chunks[c].end = (c == nthreads - 1) ? n : n / nthreads * (c + 1);
+  }
+  run_chunks(chunks, nthreads, build_records);
+
+  // choose the top-level buckets of each prefix that occurs
+  s->num_buckets = 0;
+  for (int p = 0; p < NUM_PREFIXES; p++) {
+    unsigned seen = 0;
+    uint64_t or_hi = 0, or_lo = 0, and_hi = ~(uint64_t)0, and_lo = ~(uint64_t)0;
+    for (int c = 0; c < nthreads; c++) {
+      seen |= (chunks[c].seen >> p) & 1;
+      or_hi |= chunks[c].or_hi[p];
+      or_lo |= chunks[c].or_lo[p];
+      and_hi &= chunks[c].and_hi[p];
+      and_lo &= chunks[c].and_lo[p];
+    }
+    KeyDiff diff = { or_lo ^ and_lo, or_hi ^ and_hi, 0 };
+    int shift = digit_shift(diff, DIGIT_BITS);
+    s->shift[p] = (shift < 0) ? 0 : shift;
+    s->mask[p] = (shift < 0 || !seen) ? 0 : BUCKETS - 1;
+    s->base[p] = s->num_buckets;
+    s->num_buckets += seen ? s->mask[p] + 1 : 0;
+  }
+
+  run_chunks(chunks, nthreads, count_buckets);
+  // each chunk's records in bucket b go after those of the previous
+  // chunks, which keeps the sort stable
+  size_t pos = 0;
+  for (unsigned b = 0; b < s->num_buckets; b++) {
+    for (int c = 0; c < nthreads; c++) {
+      size_t count = chunks[c].counts[b];
+      chunks[c].counts[b] = pos;
+      pos += count;
+    }
+    s->ends[b] = pos;
+  }
+  run_chunks(chunks, nthreads, scatter);
+
+  // then sort the buckets, giving each thread about the same number of
+  // elements
+  unsigned b = 0;
+  for (int c = 0; c < nthreads; c++) {
+    chunks[c].bucket_begin = b;
+    while (b < s->num_buckets && (c == nthreads - 1 || s->ends[b] <= n / nthreads * (c + 1))) b++;
+    chunks[c].bucket_end = b;
+  }
+  run_chunks(chunks, nthreads, sort_buckets);
+
+  free(records);
+  free(chunks);
+  free(s);
+  return 1;
+}
@@ -0,0 +1,47 @@
+#ifndef FIXEDPOINT_SORT_H
+#define FIXEDPOINT_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fixedpoint.h"
+#include "fixedpoint_array.h"
+
+// Length in bytes of a sort key.  Valid values range from -(2^128 - 1) to
+// 2^128 - 1, which takes 129 bits, so the key is a prefix byte followed by
+// the 16 bytes of the magnitude.
+#define FIXEDPOINT_SORT_KEY_LEN 17
+
+// Compute the order-preserving binary key of a Fixedpoint value: for
+// valid values a and b, memcmp of their keys has the same sign as
+// fixedpoint_compare(a, b).  The first byte is 0 for negative values and
+// 1 for non-negative ones (including a zero with a negative tag, which
+// gets the same key as zero); the other 16 bytes are the magnitude in
+// big-endian order, inverted for negative values.  Non-valid values get
+// their tag as the first byte (so they sort after all valid values,
+// grouped by tag) followed by the magnitude.
+//
+// Parameters:
+//   val - the Fixedpoint value
+//   key - where the FIXEDPOINT_SORT_KEY_LEN bytes of the key are stored
+void fixedpoint_sort_key(Fixedpoint val, uint8_t key[FIXEDPOINT_SORT_KEY_LEN]);
+
+// Sort the elements start .. start+n-1 of an array into ascending order
+// of their sort keys (i.e. the fixedpoint_compare order for valid values).
+// This is a stable MSD radix sort: the keys are computed once into a
+// scratch buffer (twice the size of the range), which is partitioned on
+// 11-bit digits, starting at the most significant bit in which each range
+// of keys differs, with small ranges insertion sorted.
+//
+// Parameters:
+//   arr - the array
+//   start - index of the first element to sort
+//   n - the number of elements to sort
+//   nthreads - the number of threads to use, or 0 to use one per online
+//              CPU (fewer threads are used for small arrays)
+//
+// Returns:
+//   1 if successful, 0 if memory couldn't be allocated (the array is
+//   then unchanged)
+int fixedpoint_array_sort(FixedpointArray *arr, size_t start, size_t n, int nthreads);
+
+#endif // FIXEDPOINT_SORT_H
@@ -0,0 +1,176 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+// fixedpoint_lazy_sum_add is defined only in fixedpoint_sum.h; the
+// declaration below turns it into an out-of-line definition too.
+#ifndef FIXEDPOINT_INLINE
+#define FIXEDPOINT_INLINE 1
+#endif
+#include "fixedpoint_sum.h"
+#include "fixedpoint_internal.h"
+
+// Minimum number of elements summed by each thread
+#define MIN_CHUNK (1 << 16)
+
+extern inline void fixedpoint_lazy_sum_add(FixedpointLazySum *sum, Fixedpoint val);
+
+void fixedpoint_accumulator_clear(FixedpointAccumulator *acc) {
+  acc->word[0] = acc->word[1] = acc->word[2] = 0;
+  acc->invalid = 0;
+}
+
+// Add a 192-bit two's complement integer (hi, lo) to an accumulator
+static inline void add_words(FixedpointAccumulator *acc, uint64_t hi, fp_u128 lo) {
+  fp_u128 sum = (((fp_u128)acc->word[1] << 64) | acc->word[0]) + lo;
+  acc->word[0] = (uint64_t)sum;
+  acc->word[1] = (uint64_t)(sum >> 64);
+  acc->word[2] += hi + (sum < lo);
+}
+
+void fixedpoint_accumulator_add(FixedpointAccumulator *acc, Fixedpoint val) {
+  // -x is ~x + 1, and ~x sign-extends to 192 bits with an all-ones top word
+  uint64_t neg = val.tag == TAG_VALID_NEGATIVE;
+  uint64_t m = -neg;
+  add_words(acc, m, fp_magnitude(val) ^ (((fp_u128)m << 64) | m));
+  add_words(acc, 0, neg);
+  acc->invalid |= val.tag > TAG_VALID_NEGATIVE;
+}
+
+void fixedpoint_accumulator_add_array(FixedpointAccumulator *acc, const FixedpointArray *arr,
+                                      size_t start, size_t n) {
+  // the +1 of each negation is added once at the end, as the number of
+  // negative elements
+  fp_u128 lo = 0;
+  uint64_t hi = 0, num_neg = 0;
+  unsigned invalid = 0;
+  for (size_t i = start; i < start + n; i++) {
+    uint64_t neg = arr->tag[i] == TAG_VALID_NEGATIVE;
+    uint64_t m = -neg;
+    fp_u128 x = ((fp_u128)(arr->whole[i] ^ m) << 64) | (arr->frac[i] ^ m);
+    lo += x;
+    hi += m + (lo < x);
+    num_neg += neg;
+    invalid |= arr->tag[i] > TAG_VALID_NEGATIVE;
+  }
+  add_words(acc, hi, lo);
+  add_words(acc, 0, num_neg);
+  acc->invalid |= invalid;
+}
+
+void fixedpoint_accumulator_merge(FixedpointAccumulator *acc, const FixedpointAccumulator *other) {
+  add_words(acc, other->word[2], ((fp_u128)other->word[1] << 64) | other->word[0]);
+  acc->invalid |= other->invalid;
+}
+
+Fixedpoint fixedpoint_accumulator_value(const FixedpointAccumulator *acc) {
+  if (acc->invalid) return fp_from_magnitude(0, TAG_ERR);
+
+  // magnitude of the sum: negate if the top bit is set
+  uint64_t m = -(acc->word[2] >> 63);
+  fp_u128 lo = ((fp_u128)(acc->word[1] ^ m) << 64) | (acc->word[0] ^ m);
+  uint64_t hi = acc->word[2] ^ m;
+  lo += m & 1;
+  hi += (lo == 0) & m;
+
+  if (hi != 0) return fp_from_magnitude(lo, m ? TAG_NEG_OVERFLOW : TAG_POS_OVERFLOW);
+  return fp_from_magnitude(lo, (m && lo != 0) ? TAG_VALID_NEGATIVE : TAG_VALID_NONNEGATIVE);
+}
+
+void fixedpoint_lazy_sum_clear(FixedpointLazySum *sum) {
+  sum->frac = sum->whole = 0;
+  sum->frac_carries = sum->whole_carries = sum->num_neg = 0;
+  sum->invalid = 0;
+}
+
+void fixedpoint_lazy_sum_add_array(FixedpointLazySum *sum, const FixedpointArray *arr,
+                                   size_t start, size_t n) {
+  // a local copy, so that the lanes and counters can be kept in registers
+  FixedpointLazySum local = *sum;
+  for (size_t i = start; i < start + n; i++) {
+    Fixedpoint val = { arr->whole[i], arr->frac[i], arr->tag[i] };
+    fixedpoint_lazy_sum_add(&local, val);
+  }
+  *sum = local;
+}
+
+void fixedpoint_lazy_sum_merge(FixedpointLazySum *sum, const FixedpointLazySum *other) {
+  sum->frac += other->frac;
+  sum->whole += other->whole;
+  sum->frac_carries += other->frac_carries + (sum->frac < other->frac);
+  sum->whole_carries += other->whole_carries + (sum->whole < other->whole);
+  sum->num_neg += other->num_neg;
+  sum->invalid |= other->invalid;
+}
+
+void fixedpoint_accumulator_add_lazy_sum(FixedpointAccumulator *acc, const FixedpointLazySum *sum) {
+  // each negative value x was added as ~x = 2^128 - 1 - x, which the
+  // accumulator sign-extends as ~x - 2^128, so it still needs +1 - 2^128
+  add_words(acc, 0, sum->frac);
+  add_words(acc, 0, (fp_u128)sum->whole << 64);
+  add_words(acc, 0, (fp_u128)sum->frac_carries << 64);
+  add_words(acc, sum->whole_carries - sum->num_neg, sum->num_neg);
+  acc->invalid |= sum->invalid;
+}
+
+Fixedpoint fixedpoint_lazy_sum_value(const FixedpointLazySum *sum) {
+  FixedpointAccumulator acc;
+  fixedpoint_accumulator_clear(&acc);
+  fixedpoint_accumulator_add_lazy_sum(&acc, sum);
+  return fixedpoint_accumulator_value(&acc);
+}
+
+// A range of elements summed by one thread
+typedef struct {
+  const FixedpointArray *arr;
+  size_t start, n;
+  FixedpointAccumulator acc;
+  pthread_t thread;
+  int thread_started;
+} Chunk;
+
+static void *sum_chunk(void *arg) {
+  Chunk *chunk = arg;
+  fixedpoint_accumulator_add_array(&chunk->acc, chunk->arr, chunk->start, chunk->n);
+  return NULL;
+}
+
+Fixedpoint fixedpoint_array_sum(const FixedpointArray *arr, size_t start, size_t n, int nthreads) {
+  if (nthreads <= 0) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpus > 0) ? (int)ncpus : 1;
+  }
+  if ((size_t)nthreads > n / MIN_CHUNK) {
+    nthreads = (n / MIN_CHUNK > 0) ? (int)(n / MIN_CHUNK) : 1;
+  }
+
+  FixedpointAccumulator total;
+  fixedpoint_accumulator_clear(&total);
+  Chunk *chunks = (nthreads > 1) ? calloc(nthreads, sizeof(Chunk)) : NULL;
+  if (!chunks) {
+    // a single thread (or no memory for more)
+    fixedpoint_accumulator_add_array(&total, arr, start, n);
+    return fixedpoint_accumulator_value(&total);
+  }
+
+  for (int c = 0; c < nthreads; c++) {
+    size_t begin = n / nthreads * c;
+    size_t end = (c == nthreads - 1) ? n : n / nthreads * (c + 1);
+    chunks[c].arr = arr;
+    chunks[c].start = start + begin;
+    chunks[c].n = end - begin;
+    fixedpoint_accumulator_clear(&chunks[c].acc);
+  }
+  for (int c = 1; c < nthreads; c++) {
+    chunks[c].thread_started = pthread_create(&chunks[c].thread, NULL, sum_chunk, &chunks[c]) == 0;
+  }
+  sum_chunk(&chunks[0]);
+  fixedpoint_accumulator_merge(&total, &chunks[0].acc);
+  for (int c = 1; c < nthreads; c++) {
+    // if a thread couldn't be started, do its work here instead
+    if (chunks[c].thread_started) pthread_join(chunks[c].thread, NULL);
+    else sum_chunk(&chunks[c]);
+    fixedpoint_accumulator_merge(&total, &chunks[c].acc);
+  }
+  free(chunks);
+  return fixedpoint_accumulator_value(&total);
+}
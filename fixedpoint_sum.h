@@ -0,0 +1,162 @@
+#ifndef FIXEDPOINT_SUM_H
+#define FIXEDPOINT_SUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fixedpoint.h"
+#include "fixedpoint_array.h"
+
+// An exact accumulator for sums of Fixedpoint values: a 192-bit two's
+// complement integer counting units of 2^-64.  Valid values need 129 bits,
+// so the remaining 63 bits of headroom let at least 2^63 values be added
+// without the accumulator itself overflowing, however large the partial
+// sums get; only the final value can overflow.  Since the sum is exact, it
+// doesn't depend on the order in which the values were added, so partial
+// sums computed in separate threads can be merged in any order and always
+// give the same result.
+typedef struct {
+  uint64_t word[3]; // least significant word first
+  unsigned invalid; // nonzero if a non-valid value was added
+} FixedpointAccumulator;
+
+// Reset an accumulator to zero.
+//
+// Parameters:
+//   acc - the accumulator
+void fixedpoint_accumulator_clear(FixedpointAccumulator *acc);
+
+// Add a value to an accumulator.  If the value isn't valid, the value of
+// the accumulator becomes an error (see fixedpoint_accumulator_value).
+//
+// Parameters:
+//   acc - the accumulator
+//   val - the value to add
+void fixedpoint_accumulator_add(FixedpointAccumulator *acc, Fixedpoint val);
+
+// Add the elements start .. start+n-1 of an array to an accumulator.
+//
+// Parameters:
+//   acc - the accumulator
+//   arr - the array
+//   start - index of the first element to add
+//   n - the number of elements
+void fixedpoint_accumulator_add_array(FixedpointAccumulator *acc, const FixedpointArray *arr,
+                                      size_t start, size_t n);
+
+// Add the sum in one accumulator to another.
+//
+// Parameters:
+//   acc - the accumulator to add to
+//   other - the accumulator to add
+void fixedpoint_accumulator_merge(FixedpointAccumulator *acc, const FixedpointAccumulator *other);
+
+// Get the sum in an accumulator as a Fixedpoint value.
+//
+// Parameters:
+//   acc - the accumulator
+//
+// Returns:
+//   the sum; if its magnitude doesn't fit in 128 bits, the tag is
+//   TAG_POS_OVERFLOW or TAG_NEG_OVERFLOW and the magnitude is wrapped
+//   modulo 2^128 (like fixedpoint_add); if a non-valid value was added,
+//   a value with TAG_ERR
+Fixedpoint fixedpoint_accumulator_value(const FixedpointAccumulator *acc);
+
+// Sum the elements start .. start+n-1 of an array exactly, splitting the
+// work between threads.  The result doesn't depend on the number of
+// threads.
+//
+// Parameters:
+//   arr - the array
+//   start - index of the first element to add
+//   n - the number of elements
+//   nthreads - the number of threads to use, or 0 to use one per online
+//              CPU (fewer threads are used for small arrays)
+//
+// Returns:
+//   the sum, as returned by fixedpoint_accumulator_value
+Fixedpoint fixedpoint_array_sum(const FixedpointArray *arr, size_t start, size_t n, int nthreads);
+
+// A running sum with deferred normalization, for hot loops adding one
+// value at a time.  Where fixedpoint_add resolves the carry from the
+// fractional to the whole part and the sign of the result on every
+// addition, a FixedpointLazySum keeps the fractional and whole parts in
+// separate lanes, each with a count of the carries out of it.  A negative
+// value is added as the one's complement of its parts, and the +1 that
+// would complete the negation is only counted.  Adding a value updates
+// the two lanes independently, so the CPU can overlap consecutive
+// additions; the carries and the sign are only resolved by
+// fixedpoint_lazy_sum_value.  The counters allow 2^64 - 1 values to be
+// added, and like FixedpointAccumulator the result is exact and only the
+// final value can overflow.
+typedef struct {
+  uint64_t frac;          // sum of the fractional lanes, modulo 2^64
+  uint64_t whole;         // sum of the whole lanes, modulo 2^64
+  uint64_t frac_carries;  // carries out of frac (each worth 1)
+  uint64_t whole_carries; // carries out of whole (each worth 2^64)
+  uint64_t num_neg;       // number of negative values added
+  unsigned invalid;       // nonzero if a non-valid value was added
+} FixedpointLazySum;
+
+// Reset a lazy sum to zero.
+//
+// Parameters:
+//   sum - the lazy sum
+void fixedpoint_lazy_sum_clear(FixedpointLazySum *sum);
+
+// Add a value to a lazy sum (see FIXEDPOINT_INLINE in fixedpoint.h).  If
+// the value isn't valid, the value of the sum becomes an error.
+//
+// Parameters:
+//   sum - the lazy sum
+//   val - the value to add
+FIXEDPOINT_INLINE_FN void fixedpoint_lazy_sum_add(FixedpointLazySum *sum, Fixedpoint val);
+
+// Add the elements start .. start+n-1 of an array to a lazy sum.
+//
+// Parameters:
+//   sum - the lazy sum
+//   arr - the array
+//   start - index of the first element to add
+//   n - the number of elements
+void fixedpoint_lazy_sum_add_array(FixedpointLazySum *sum, const FixedpointArray *arr,
+                                   size_t start, size_t n);
+
+// Add the value of one lazy sum to another.
+//
+// Parameters:
+//   sum - the lazy sum to add to
+//   other - the lazy sum to add
+void fixedpoint_lazy_sum_merge(FixedpointLazySum *sum, const FixedpointLazySum *other);
+
+// Add the value of a lazy sum to an accumulator.
+//
+// Parameters:
+//   acc - the accumulator
+//   sum - the lazy sum
+void fixedpoint_accumulator_add_lazy_sum(FixedpointAccumulator *acc, const FixedpointLazySum *sum);
+
+// Get the value of a lazy sum as a Fixedpoint value, resolving the
+// carries and the sign.
+//
+// Parameters:
+//   sum - the lazy sum
+//
+// Returns:
+//   the sum, with the same conventions as fixedpoint_accumulator_value
+Fixedpoint fixedpoint_lazy_sum_value(const FixedpointLazySum *sum);
+
+#ifdef FIXEDPOINT_INLINE
+FIXEDPOINT_INLINE_FN void fixedpoint_lazy_sum_add(FixedpointLazySum *sum, Fixedpoint val) {
+  uint64_t neg = val.tag == TAG_VALID_NEGATIVE;
+  uint64_t frac = val.frac ^ -neg, whole = val.whole ^ -neg;
+  sum->frac += frac;
+  sum->frac_carries += sum->frac < frac;
+  sum->whole += whole;
+  sum->whole_carries += sum->whole < whole;
+  sum->num_neg += neg;
+  sum->invalid |= val.tag > TAG_VALID_NEGATIVE;
+}
+#endif
+
+#endif // FIXEDPOINT_SUM_H
@@ -1,6 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "fixedpoint.h"
+#include "fixedpoint_array.h"
+#include "fixedpoint_dispatch.h"
+#include "fixedpoint_internal.h"
+#include "fixedpoint_io.h"
+#include "fixedpoint_packed.h"
+#include "fixedpoint_sort.h"
+#include "fixedpoint_sum.h"
 #include "tctest.h"
 
 #define CHECK_GREATER(a, b) \
@@ -35,6 +44,10 @@ typedef struct {
   Fixedpoint max;
   Fixedpoint min;
 
+  // all of the valid values above, and their negations
+  Fixedpoint all[20];
+  int num_all;
+
   // TODO: add more objects to the test fixture
 } TestObjs;
 
@@ -46,11 +59,36 @@ void cleanup(TestObjs *objs);
 void test_whole_part(TestObjs *objs);
 void test_frac_part(TestObjs *objs);
 void test_create_from_hex(TestObjs *objs);
+void test_parse_hex(TestObjs *objs);
 void test_fixedpoint_halve(TestObjs *objs);
 void test_format_as_hex(TestObjs *objs);
+void test_format_as_hex_into(TestObjs *objs);
 void test_negate(TestObjs *objs);
 void test_add(TestObjs *objs);
 void test_sub(TestObjs *objs);
+void test_mul(TestObjs *objs);
+void test_div(TestObjs *objs);
+void test_reciprocal(TestObjs *objs);
+void test_is_div_by_zero(TestObjs *objs);
+void test_array_load_store(TestObjs *objs);
+void test_array_add_sub(TestObjs *objs);
+void test_array_unary(TestObjs *objs);
+void test_array_compare(TestObjs *objs);
+void test_array_status(TestObjs *objs);
+void test_saturating(TestObjs *objs);
+void test_scale_pow2(TestObjs *objs);
+void test_sort_key(TestObjs *objs);
+void test_array_sort(TestObjs *objs);
+void test_accumulator(TestObjs *objs);
+void test_lazy_sum(TestObjs *objs);
+void test_addsub_kernels(TestObjs *objs);
+void test_packed_get_set(TestObjs *objs);
+void test_packed_ops(TestObjs *objs);
+void test_dispatch(TestObjs *objs);
+void test_load_hex_buffer(TestObjs *objs);
+void test_load_hex_fd(TestObjs *objs);
+void test_load_hex_parallel(TestObjs *objs);
+void test_concurrent_ops(TestObjs *objs);
 void test_is_overflow_pos(TestObjs *objs);
 void test_is_overflow_neg(TestObjs *objs);
 void test_is_underflow_pos(TestObjs *objs);
@@ -63,12 +101,30 @@ void test_remove_trailing_zeros(TestObjs *objs);
 void test_halve(TestObjs *objs);
 void test_double(TestObjs *objs);
 void test_compare(TestObjs *objs);
+void test_out_of_line(TestObjs *objs);
 // TODO: add more test functions
 
+void bench_add(TestObjs *objs);
+void bench_compare(TestObjs *objs);
+void bench_mul(TestObjs *objs);
+void bench_parse_hex(TestObjs *objs);
+void bench_format_as_hex_into(TestObjs *objs);
+
 int main(int argc, char **argv) {
+  // "-j N" runs N tests in parallel
+  if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+    tctest_jobs = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+
   // if a testname was specified on the command line, only that
-  // test function will be executed
-  if (argc > 1) {
+  // test function will be executed; "--bench [name]" runs the
+  // benchmarks (or only the named one) instead of the tests
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    tctest_benchname_to_execute = (argc > 2) ? argv[2] : "";
+    tctest_testname_to_execute = "";
+  } else if (argc > 1) {
     tctest_testname_to_execute = argv[1];
   }
 
@@ -77,11 +133,36 @@ int main(int argc, char **argv) {
   TEST(test_whole_part);
   TEST(test_frac_part);
   TEST(test_create_from_hex);
+  TEST(test_parse_hex);
   TEST(test_fixedpoint_halve);
   TEST(test_format_as_hex);
+  TEST(test_format_as_hex_into);
   TEST(test_negate);
   TEST(test_add);
   TEST(test_sub);
+  TEST(test_mul);
+  TEST(test_div);
+  TEST(test_reciprocal);
+  TEST(test_is_div_by_zero);
+  TEST(test_array_load_store);
+  TEST(test_array_add_sub);
+  TEST(test_array_unary);
+  TEST(test_array_compare);
+  TEST(test_array_status);
+  TEST(test_saturating);
+  TEST(test_scale_pow2);
+  TEST(test_sort_key);
+  TEST(test_array_sort);
+  TEST(test_accumulator);
+  TEST(test_lazy_sum);
+  TEST(test_addsub_kernels);
+  TEST(test_packed_get_set);
+  TEST(test_packed_ops);
+  TEST(test_dispatch);
+  TEST(test_load_hex_buffer);
+  TEST(test_load_hex_fd);
+  TEST(test_load_hex_parallel);
+  TEST_PARALLEL(test_concurrent_ops, 8);
   TEST(test_is_overflow_pos);
   TEST(test_is_overflow_neg);
   TEST(test_is_underflow_pos);
@@ -94,6 +175,13 @@ int main(int argc, char **argv) {
   TEST(test_halve);
   TEST(test_double);
   TEST(test_compare);
+  TEST(test_out_of_line);
+
+  BENCH(bench_add, 64);
+  BENCH(bench_compare, 64);
+  BENCH(bench_mul, 64);
+  BENCH(bench_parse_hex, 16);
+  BENCH(bench_format_as_hex_into, 16);
 
   // IMPORTANT: if you add additional test functions (which you should!),
   // make sure they are included here.  E.g., if you add a test function
@@ -120,6 +208,15 @@ TestObjs *setup(void) {
   objs->neg_one_eighth = fixedpoint_create_from_hex("-0.2");
   objs->min = fixedpoint_create_from_hex("-ffffffffffffffff.ffffffffffffffff");
 
+  Fixedpoint vals[] = { objs->zero, objs->one, objs->one_half, objs->one_fourth,
+                        objs->large1, objs->large2, objs->neg_1, objs->neg_one_eighth,
+                        objs->max, objs->min };
+  objs->num_all = 0;
+  for (int i = 0; i < (int)(sizeof(vals) / sizeof(vals[0])); i++) {
+    objs->all[objs->num_all++] = vals[i];
+    objs->all[objs->num_all++] = fixedpoint_negate(vals[i]);
+  }
+
   return objs;
 }
 
@@ -233,11 +330,68 @@ void test_create_from_hex(TestObjs *objs) {
   ASSERT(fixedpoint_is_valid(val18));
   ASSERT(0xf6a5865UL == fixedpoint_whole_part(val18));
   ASSERT(0x00f2000000000000UL == fixedpoint_frac_part(val18));
+
+  // at most 16 digits in each part
+  ASSERT(fixedpoint_is_err(fixedpoint_create_from_hex("10000000000000000")));
+  ASSERT(fixedpoint_is_err(fixedpoint_create_from_hex("0.00000000000000001")));
+  ASSERT(fixedpoint_is_err(fixedpoint_create_from_hex("-")));
+  ASSERT(fixedpoint_is_err(fixedpoint_create_from_hex("1 ")));
+
+  // zero is never negative
+  Fixedpoint val19 = fixedpoint_create_from_hex("-0.0");
+  ASSERT(fixedpoint_is_valid(val19));
+  ASSERT(!fixedpoint_is_neg(val19));
+  ASSERT(fixedpoint_is_zero(val19));
+  Fixedpoint val20 = fixedpoint_create_from_hex("-.");
+  ASSERT(fixedpoint_is_valid(val20));
+  ASSERT(!fixedpoint_is_neg(val20));
 }
 
-void test_compare(TestObjs *objs) {
+void test_parse_hex(TestObjs *objs) {
   (void) objs;
+  Fixedpoint val;
+
+  // the value may be followed by other characters
+  ASSERT(12 == fixedpoint_parse_hex("f6a5865.00f2\n", 13, &val));
+  ASSERT(fixedpoint_is_valid(val));
+  ASSERT(0xf6a5865UL == fixedpoint_whole_part(val));
+  ASSERT(0x00f2000000000000UL == fixedpoint_frac_part(val));
+
+  // only len characters are looked at
+  ASSERT(3 == fixedpoint_parse_hex("-1.8", 3, &val));
+  ASSERT(fixedpoint_is_neg(val));
+  ASSERT(1UL == fixedpoint_whole_part(val));
+  ASSERT(0UL == fixedpoint_frac_part(val));
+
+  ASSERT(34 == fixedpoint_parse_hex("-ffffffffffffffff.ffffffffffffffff,", 35, &val));
+  ASSERT(fixedpoint_is_neg(val));
+  ASSERT(0xffffffffffffffffUL == fixedpoint_whole_part(val));
+  ASSERT(0xffffffffffffffffUL == fixedpoint_frac_part(val));
+
+  ASSERT(3 == fixedpoint_parse_hex("1.8.3", 5, &val));
+  ASSERT(fixedpoint_is_valid(val));
+  ASSERT(1 == fixedpoint_parse_hex(".", 1, &val));
+  ASSERT(fixedpoint_is_valid(val));
+  ASSERT(fixedpoint_is_zero(val));
+
+  // errors: the offset of the offending character is returned
+  ASSERT(0 == fixedpoint_parse_hex("", 0, &val));
+  ASSERT(fixedpoint_is_err(val));
+  ASSERT(0 == fixedpoint_parse_hex(NULL, 0, &val));
+  ASSERT(fixedpoint_is_err(val));
+  ASSERT(1 == fixedpoint_parse_hex("-", 1, &val));
+  ASSERT(fixedpoint_is_err(val));
+  ASSERT(1 == fixedpoint_parse_hex("--1", 3, &val));
+  ASSERT(fixedpoint_is_err(val));
+  ASSERT(0 == fixedpoint_parse_hex("x1", 2, &val));
+  ASSERT(fixedpoint_is_err(val));
+  ASSERT(16 == fixedpoint_parse_hex("10000000000000000", 17, &val));
+  ASSERT(fixedpoint_is_err(val));
+  ASSERT(19 == fixedpoint_parse_hex("-1.00000000000000001", 20, &val));
+  ASSERT(fixedpoint_is_err(val));
+}
 
+void test_compare(TestObjs *objs) {
   Fixedpoint lhs, rhs;
 
   lhs = fixedpoint_create2(0xed3fdUL, 0x978c68d97fdc4c00UL);
@@ -263,6 +417,52 @@ void test_compare(TestObjs *objs) {
   rhs = fixedpoint_create2(0x0UL, 0x0UL);
   rhs = fixedpoint_negate(rhs);
   CHECK_EQUAL(lhs, rhs);
+  // a zero carrying a negative tag still compares equal to zero
+  lhs = objs->zero;
+  lhs.tag = TAG_VALID_NEGATIVE;
+  CHECK_EQUAL(lhs, objs->zero);
+  CHECK_LESS(objs->min, objs->max);
+  CHECK_LESS(objs->min, objs->neg_1);
+  CHECK_GREATER(objs->one, objs->neg_one_eighth);
+}
+
+// The out-of-line definitions must exist (and agree with the inline ones
+// when built with FIXEDPOINT_INLINE); calls through volatile function
+// pointers can't be inlined.
+void test_out_of_line(TestObjs *objs) {
+  uint64_t (*volatile part)(Fixedpoint) = fixedpoint_whole_part;
+  int (*volatile pred)(Fixedpoint) = fixedpoint_is_valid;
+  int (*volatile cmp)(Fixedpoint, Fixedpoint) = fixedpoint_compare;
+  Fixedpoint (*volatile neg)(Fixedpoint) = fixedpoint_negate;
+  Fixedpoint ulp = fixedpoint_create2(0UL, 1UL);
+
+  for (int i = 0; i < objs->num_all; i++) {
+    Fixedpoint val = objs->all[i];
+    ASSERT(part(val) == fixedpoint_whole_part(val));
+    ASSERT(pred(val) == fixedpoint_is_valid(val));
+    ASSERT(fixedpoint_compare(neg(val), fixedpoint_negate(val)) == 0);
+    for (int j = 0; j < objs->num_all; j++) {
+      ASSERT(cmp(val, objs->all[j]) == fixedpoint_compare(val, objs->all[j]));
+    }
+  }
+  part = fixedpoint_frac_part;
+  ASSERT(part(objs->one_half) == 0x8000000000000000UL);
+  pred = fixedpoint_is_zero;
+  ASSERT(pred(objs->zero));
+  pred = fixedpoint_is_neg;
+  ASSERT(pred(objs->neg_1));
+  pred = fixedpoint_is_err;
+  ASSERT(pred(fixedpoint_create_from_hex("x")));
+  pred = fixedpoint_is_overflow_pos;
+  ASSERT(pred(fixedpoint_add(objs->max, objs->max)));
+  pred = fixedpoint_is_overflow_neg;
+  ASSERT(pred(fixedpoint_add(objs->min, objs->min)));
+  pred = fixedpoint_is_underflow_pos;
+  ASSERT(pred(fixedpoint_halve(ulp)));
+  pred = fixedpoint_is_underflow_neg;
+  ASSERT(pred(fixedpoint_halve(fixedpoint_negate(ulp))));
+  pred = fixedpoint_is_div_by_zero;
+  ASSERT(pred(fixedpoint_div(objs->one, objs->zero)));
 }
 
 void test_fixedpoint_halve(TestObjs *objs) {
@@ -309,6 +509,55 @@ void test_format_as_hex(TestObjs *objs) {
   s = fixedpoint_format_as_hex(objs->large2);
   ASSERT(0 == strcmp(s, "fcbf3d5.00004d1a23c24faf"));
   free(s);
+
+  // trailing zeros of the whole part are kept
+  s = fixedpoint_format_as_hex(fixedpoint_create(0x100UL));
+  ASSERT(0 == strcmp(s, "100"));
+  free(s);
+
+  s = fixedpoint_format_as_hex(fixedpoint_create2(0x10UL, 0x1000000000000000UL));
+  ASSERT(0 == strcmp(s, "10.1"));
+  free(s);
+
+  s = fixedpoint_format_as_hex(objs->min);
+  ASSERT(0 == strcmp(s, "-ffffffffffffffff.ffffffffffffffff"));
+  free(s);
+
+  s = fixedpoint_format_as_hex(objs->neg_one_eighth);
+  ASSERT(0 == strcmp(s, "-0.2"));
+  free(s);
+}
+
+void test_format_as_hex_into(TestObjs *objs) {
+  char buf[FIXEDPOINT_HEX_MAX_LEN + 1];
+
+  ASSERT(1 == fixedpoint_format_as_hex_into(objs->zero, buf, sizeof(buf)));
+  ASSERT(0 == strcmp(buf, "0"));
+  ASSERT(26 == fixedpoint_format_as_hex_into(objs->large1, buf, sizeof(buf)));
+  ASSERT(0 == strcmp(buf, "4b19efcea.000000ec9a1e2418"));
+  ASSERT(34 == fixedpoint_format_as_hex_into(objs->min, buf, sizeof(buf)));
+  ASSERT(0 == strcmp(buf, "-ffffffffffffffff.ffffffffffffffff"));
+  ASSERT(4 == fixedpoint_format_as_hex_into(objs->neg_one_eighth, buf, sizeof(buf)));
+  ASSERT(0 == strcmp(buf, "-0.2"));
+  ASSERT(8 == fixedpoint_format_as_hex_into(fixedpoint_create(0xf0000000UL), buf, sizeof(buf)));
+  ASSERT(0 == strcmp(buf, "f0000000"));
+
+  // same result as fixedpoint_format_as_hex
+  for (int i = 0; i < objs->num_all; i++) {
+    char *s = fixedpoint_format_as_hex(objs->all[i]);
+    ASSERT(strlen(s) == fixedpoint_format_as_hex_into(objs->all[i], buf, sizeof(buf)));
+    ASSERT(0 == strcmp(s, buf));
+    free(s);
+  }
+
+  // truncation: the length of the full string is still returned
+  memset(buf, 'x', sizeof(buf));
+  ASSERT(26 == fixedpoint_format_as_hex_into(objs->large1, buf, 6));
+  ASSERT(0 == strcmp(buf, "4b19e"));
+  ASSERT('x' == buf[6]);
+  ASSERT(26 == fixedpoint_format_as_hex_into(objs->large1, buf, 1));
+  ASSERT(0 == strcmp(buf, ""));
+  ASSERT(26 == fixedpoint_format_as_hex_into(objs->large1, NULL, 0));
 }
 
 void test_negate(TestObjs *objs) {
@@ -371,8 +620,6 @@ void test_negate(TestObjs *objs) {
 }
 
 void test_add(TestObjs *objs) {
-  (void) objs;
-
   Fixedpoint lhs1, rhs1, sum1, lhs2, rhs2, sum2, lhs3, rhs3, sum3;
 
   lhs1 = fixedpoint_create_from_hex("-c7252a193ae07.7a51de9ea0538c5");
@@ -391,6 +638,25 @@ void test_add(TestObjs *objs) {
   rhs3 = fixedpoint_create_from_hex("-1");
   sum3 = fixedpoint_add(lhs3, rhs3);
   ASSERT(fixedpoint_is_overflow_neg(sum3));
+
+  // values of equal magnitude and opposite sign cancel to a non-negative zero
+  sum1 = fixedpoint_add(objs->neg_1, objs->one);
+  ASSERT(fixedpoint_is_valid(sum1));
+  ASSERT(fixedpoint_is_zero(sum1));
+  ASSERT(!fixedpoint_is_neg(sum1));
+  sum1 = fixedpoint_add(objs->max, objs->min);
+  ASSERT(fixedpoint_is_zero(sum1));
+  ASSERT(!fixedpoint_is_neg(sum1));
+
+  // largest representable magnitudes
+  sum2 = fixedpoint_add(objs->min, objs->one);
+  ASSERT(fixedpoint_is_neg(sum2));
+  ASSERT(0xfffffffffffffffeUL == fixedpoint_whole_part(sum2));
+  ASSERT(0xffffffffffffffffUL == fixedpoint_frac_part(sum2));
+  sum3 = fixedpoint_add(objs->min, fixedpoint_create_from_hex("-0.0000000000000001"));
+  ASSERT(fixedpoint_is_overflow_neg(sum3));
+  ASSERT(0UL == fixedpoint_whole_part(sum3));
+  ASSERT(0UL == fixedpoint_frac_part(sum3));
 }
 
 void test_sub(TestObjs *objs) {
@@ -416,6 +682,156 @@ void test_sub(TestObjs *objs) {
   ASSERT(fixedpoint_is_overflow_pos(diff3));
 }
 
+void test_mul(TestObjs *objs) {
+  Fixedpoint res;
+
+  // integer * integer
+  res = fixedpoint_mul(fixedpoint_create(0x12345UL), fixedpoint_create(0x10000UL));
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(!fixedpoint_is_neg(res));
+  ASSERT(0x123450000UL == fixedpoint_whole_part(res));
+  ASSERT(0UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_mul(fixedpoint_create(0x100000000UL), fixedpoint_create(0x100000000UL));
+  ASSERT(fixedpoint_is_overflow_pos(res));
+
+  // fraction * fraction
+  res = fixedpoint_mul(objs->one_half, objs->one_fourth);
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(0UL == fixedpoint_whole_part(res));
+  ASSERT(0x2000000000000000UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_mul(objs->neg_one_eighth, objs->one_half);
+  ASSERT(fixedpoint_is_neg(res));
+  ASSERT(0x1000000000000000UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_mul(fixedpoint_create_from_hex("0.0000000000000001"), objs->one_half);
+  ASSERT(fixedpoint_is_underflow_pos(res));
+  ASSERT(0UL == fixedpoint_frac_part(res));
+
+  // general case
+  res = fixedpoint_mul(fixedpoint_create_from_hex("-3.8"), fixedpoint_create_from_hex("2.4"));
+  ASSERT(fixedpoint_is_neg(res));
+  ASSERT(0x7UL == fixedpoint_whole_part(res));
+  ASSERT(0xe000000000000000UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_mul(fixedpoint_create_from_hex("-ffff.0001"), objs->neg_1);
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(!fixedpoint_is_neg(res));
+  ASSERT(0xffffUL == fixedpoint_whole_part(res));
+  ASSERT(0x0001000000000000UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_mul(objs->large1, objs->large2);
+  ASSERT(fixedpoint_is_underflow_pos(res));
+
+  res = fixedpoint_mul(objs->max, objs->one);
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(0 == fixedpoint_compare(res, objs->max));
+
+  res = fixedpoint_mul(objs->min, fixedpoint_create2(1UL, 0x8000000000000000UL));
+  ASSERT(fixedpoint_is_overflow_neg(res));
+
+  // zero has no sign
+  res = fixedpoint_mul(objs->zero, objs->neg_1);
+  ASSERT(fixedpoint_is_zero(res));
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(!fixedpoint_is_neg(res));
+}
+
+void test_div(TestObjs *objs) {
+  Fixedpoint res;
+
+  // exact quotients
+  res = fixedpoint_div(fixedpoint_create(0x123450000UL), fixedpoint_create(0x10000UL));
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(0x12345UL == fixedpoint_whole_part(res));
+  ASSERT(0UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_div(objs->one, fixedpoint_create(8UL));
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(0UL == fixedpoint_whole_part(res));
+  ASSERT(0x2000000000000000UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_div(fixedpoint_create_from_hex("-7.e"), fixedpoint_create_from_hex("2.4"));
+  ASSERT(fixedpoint_is_neg(res));
+  ASSERT(0x3UL == fixedpoint_whole_part(res));
+  ASSERT(0x8000000000000000UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_div(objs->min, objs->neg_1);
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(!fixedpoint_is_neg(res));
+  ASSERT(0 == fixedpoint_compare(res, objs->max));
+
+  res = fixedpoint_div(objs->large1, objs->large1);
+  ASSERT(0 == fixedpoint_compare(res, objs->one));
+
+  res = fixedpoint_div(objs->zero, objs->neg_one_eighth);
+  ASSERT(fixedpoint_is_zero(res));
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(!fixedpoint_is_neg(res));
+
+  // inexact quotients are truncated
+  res = fixedpoint_div(objs->one, fixedpoint_create(3UL));
+  ASSERT(fixedpoint_is_underflow_pos(res));
+  ASSERT(0UL == fixedpoint_whole_part(res));
+  ASSERT(0x5555555555555555UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_div(objs->neg_1, fixedpoint_create(3UL));
+  ASSERT(fixedpoint_is_underflow_neg(res));
+
+  // quotients that are too large
+  res = fixedpoint_div(objs->max, objs->one_half);
+  ASSERT(fixedpoint_is_overflow_pos(res));
+
+  res = fixedpoint_div(objs->max, fixedpoint_negate(objs->max));
+  ASSERT(fixedpoint_is_neg(res));
+  ASSERT(0 == fixedpoint_compare(res, objs->neg_1));
+
+  res = fixedpoint_div(fixedpoint_create(1UL << 63), fixedpoint_create_from_hex("-0.4"));
+  ASSERT(fixedpoint_is_overflow_neg(res));
+}
+
+void test_reciprocal(TestObjs *objs) {
+  Fixedpoint res;
+
+  res = fixedpoint_reciprocal(objs->one_fourth);
+  ASSERT(fixedpoint_is_valid(res));
+  ASSERT(4UL == fixedpoint_whole_part(res));
+  ASSERT(0UL == fixedpoint_frac_part(res));
+
+  res = fixedpoint_reciprocal(objs->neg_one_eighth);
+  ASSERT(fixedpoint_is_neg(res));
+  ASSERT(8UL == fixedpoint_whole_part(res));
+
+  res = fixedpoint_reciprocal(fixedpoint_create(10UL));
+  ASSERT(fixedpoint_is_underflow_pos(res));
+  ASSERT(0x1999999999999999UL == fixedpoint_frac_part(res));
+
+  // 1 / 2^-64 = 2^64 doesn't fit
+  res = fixedpoint_reciprocal(fixedpoint_create2(0UL, 1UL));
+  ASSERT(fixedpoint_is_overflow_pos(res));
+
+  res = fixedpoint_reciprocal(objs->max);
+  ASSERT(fixedpoint_is_underflow_pos(res));
+  ASSERT(0UL == fixedpoint_whole_part(res));
+  ASSERT(1UL == fixedpoint_frac_part(res));
+}
+
+void test_is_div_by_zero(TestObjs *objs) {
+  Fixedpoint res;
+
+  res = fixedpoint_div(objs->one, objs->zero);
+  ASSERT(fixedpoint_is_div_by_zero(res));
+  ASSERT(!fixedpoint_is_valid(res));
+  ASSERT(!fixedpoint_is_err(res));
+
+  res = fixedpoint_reciprocal(objs->zero);
+  ASSERT(fixedpoint_is_div_by_zero(res));
+
+  res = fixedpoint_div(objs->zero, objs->one);
+  ASSERT(!fixedpoint_is_div_by_zero(res));
+}
+
 void test_is_overflow_pos(TestObjs *objs) {
   Fixedpoint sum;
 
@@ -694,3 +1110,914 @@ void test_remove_trailing_zeros(TestObjs *objs) {
   ASSERT(strcmp(str2, "0") == 0);
   ASSERT(strcmp(str3, "-1") == 0);
 }
+
+// Check that two Fixedpoint values have identical fields
+#define CHECK_IDENTICAL(a, b) \
+do { \
+  Fixedpoint a_ = (a), b_ = (b); \
+  ASSERT(a_.tag == b_.tag); \
+  ASSERT(a_.whole == b_.whole); \
+  ASSERT(a_.frac == b_.frac); \
+} while (0)
+
+void test_array_load_store(TestObjs *objs) {
+  FixedpointArray *arr = fixedpoint_array_create(objs->num_all + 3);
+  Fixedpoint out[20];
+
+  ASSERT(arr != NULL);
+  ASSERT(0 == (uintptr_t)arr->whole % FIXEDPOINT_ARRAY_ALIGN);
+  ASSERT(0 == (uintptr_t)arr->frac % FIXEDPOINT_ARRAY_ALIGN);
+  ASSERT(0 == (uintptr_t)arr->tag % FIXEDPOINT_ARRAY_ALIGN);
+
+  // new arrays are zero-filled
+  ASSERT(fixedpoint_is_zero(fixedpoint_array_get(arr, 0)));
+  ASSERT(fixedpoint_is_valid(fixedpoint_array_get(arr, 0)));
+
+  fixedpoint_array_load(arr, 3, objs->all, objs->num_all);
+  fixedpoint_array_store(arr, 3, out, objs->num_all);
+  for (int i = 0; i < objs->num_all; i++) {
+    CHECK_IDENTICAL(objs->all[i], out[i]);
+    CHECK_IDENTICAL(objs->all[i], fixedpoint_array_get(arr, i + 3));
+  }
+
+  fixedpoint_array_set(arr, 1, objs->large2);
+  CHECK_IDENTICAL(objs->large2, fixedpoint_array_get(arr, 1));
+
+  fixedpoint_array_destroy(arr);
+
+  // lengths whose size in bytes doesn't fit in a size_t
+  ASSERT(fixedpoint_array_create(SIZE_MAX) == NULL);
+  ASSERT(fixedpoint_array_create(SIZE_MAX / sizeof(uint64_t) + 1) == NULL);
+}
+
+void test_array_add_sub(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointArray *left = fixedpoint_array_create(n * n);
+  FixedpointArray *right = fixedpoint_array_create(n * n);
+  FixedpointArray *sum = fixedpoint_array_create(n * n);
+  FixedpointArray *diff = fixedpoint_array_create(n * n);
+
+  // every pair of test values
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      fixedpoint_array_set(left, i * n + j, objs->all[i]);
+      fixedpoint_array_set(right, i * n + j, objs->all[j]);
+    }
+  }
+
+  fixedpoint_array_add(sum, left, right, 0, n * n);
+  fixedpoint_array_sub(diff, left, right, 0, n * n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      CHECK_IDENTICAL(fixedpoint_add(objs->all[i], objs->all[j]),
+                      fixedpoint_array_get(sum, i * n + j));
+      CHECK_IDENTICAL(fixedpoint_sub(objs->all[i], objs->all[j]),
+                      fixedpoint_array_get(diff, i * n + j));
+    }
+  }
+
+  // in place, on a sub-range only
+  fixedpoint_array_add(left, left, right, n, n);
+  CHECK_IDENTICAL(objs->all[0], fixedpoint_array_get(left, n - 1));
+  for (int j = 0; j < n; j++) {
+    CHECK_IDENTICAL(fixedpoint_add(objs->all[1], objs->all[j]),
+                    fixedpoint_array_get(left, n + j));
+  }
+  CHECK_IDENTICAL(objs->all[2], fixedpoint_array_get(left, 2 * n));
+
+  fixedpoint_array_destroy(left);
+  fixedpoint_array_destroy(right);
+  fixedpoint_array_destroy(sum);
+  fixedpoint_array_destroy(diff);
+}
+
+void test_array_unary(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointArray *src = fixedpoint_array_create(n);
+  FixedpointArray *dst = fixedpoint_array_create(n);
+
+  fixedpoint_array_load(src, 0, objs->all, n);
+
+  fixedpoint_array_negate(dst, src, 0, n);
+  for (int i = 0; i < n; i++) {
+    CHECK_IDENTICAL(fixedpoint_negate(objs->all[i]), fixedpoint_array_get(dst, i));
+  }
+
+  fixedpoint_array_halve(dst, src, 0, n);
+  for (int i = 0; i < n; i++) {
+    CHECK_IDENTICAL(fixedpoint_halve(objs->all[i]), fixedpoint_array_get(dst, i));
+  }
+
+  fixedpoint_array_double(dst, src, 0, n);
+  for (int i = 0; i < n; i++) {
+    CHECK_IDENTICAL(fixedpoint_double(objs->all[i]), fixedpoint_array_get(dst, i));
+  }
+
+  // in place
+  fixedpoint_array_double(src, src, 0, n);
+  for (int i = 0; i < n; i++) {
+    CHECK_IDENTICAL(fixedpoint_double(objs->all[i]), fixedpoint_array_get(src, i));
+  }
+
+  fixedpoint_array_destroy(src);
+  fixedpoint_array_destroy(dst);
+}
+
+void test_array_compare(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointArray *left = fixedpoint_array_create(n * n);
+  FixedpointArray *right = fixedpoint_array_create(n * n);
+  int8_t *res = malloc(n * n);
+
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      fixedpoint_array_set(left, i * n + j, objs->all[i]);
+      fixedpoint_array_set(right, i * n + j, objs->all[j]);
+    }
+  }
+
+  fixedpoint_array_compare(res, left, right, 0, n * n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      ASSERT(fixedpoint_compare(objs->all[i], objs->all[j]) == res[i * n + j]);
+    }
+  }
+
+  free(res);
+  fixedpoint_array_destroy(left);
+  fixedpoint_array_destroy(right);
+}
+
+void test_packed_get_set(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointPackedArray *arr = fixedpoint_packed_create(n + 70);
+  FixedpointArray *unpacked = fixedpoint_array_create(n + 70);
+  Fixedpoint err = fixedpoint_create_from_hex("x");
+  Fixedpoint overflow = fixedpoint_add(objs->max, objs->max);
+
+  ASSERT(arr != NULL);
+  ASSERT(fixedpoint_is_zero(fixedpoint_packed_get(arr, 5)));
+  ASSERT(fixedpoint_is_valid(fixedpoint_packed_get(arr, 5)));
+
+  // valid values (across a sign word boundary) and non-valid ones
+  for (int i = 0; i < n; i++) {
+    ASSERT(fixedpoint_packed_set(arr, 60 + i, objs->all[i]));
+  }
+  ASSERT(fixedpoint_packed_set(arr, 3, err));
+  ASSERT(fixedpoint_packed_set(arr, 1, overflow));
+  ASSERT(fixedpoint_packed_set(arr, 2, fixedpoint_halve(fixedpoint_create2(0UL, 1UL))));
+  ASSERT(arr->num_exceptions == 3);
+  ASSERT(arr->exceptions[0].index == 1);
+  for (int i = 0; i < n; i++) {
+    CHECK_IDENTICAL(objs->all[i], fixedpoint_packed_get(arr, 60 + i));
+  }
+  CHECK_IDENTICAL(err, fixedpoint_packed_get(arr, 3));
+  CHECK_IDENTICAL(overflow, fixedpoint_packed_get(arr, 1));
+
+  // overwriting a non-valid element with a valid one removes its exception
+  ASSERT(fixedpoint_packed_set(arr, 3, objs->neg_1));
+  CHECK_IDENTICAL(objs->neg_1, fixedpoint_packed_get(arr, 3));
+  ASSERT(arr->num_exceptions == 2);
+
+  // to and from a FixedpointArray
+  fixedpoint_packed_unpack(unpacked, arr, 0, n + 70);
+  for (int i = 0; i < n + 70; i++) {
+    CHECK_IDENTICAL(fixedpoint_packed_get(arr, i), fixedpoint_array_get(unpacked, i));
+  }
+  fixedpoint_array_set(unpacked, 1, objs->one);
+  fixedpoint_array_set(unpacked, 64, err);
+  ASSERT(fixedpoint_packed_pack(arr, unpacked, 1, 64));
+  ASSERT(arr->num_exceptions == 2);
+  CHECK_IDENTICAL(objs->one, fixedpoint_packed_get(arr, 1));
+  CHECK_IDENTICAL(err, fixedpoint_packed_get(arr, 64));
+  for (int i = 0; i < n + 70; i++) {
+    CHECK_IDENTICAL(fixedpoint_array_get(unpacked, i), fixedpoint_packed_get(arr, i));
+  }
+
+  fixedpoint_packed_destroy(arr);
+  fixedpoint_array_destroy(unpacked);
+
+  // lengths whose size in bytes doesn't fit in a size_t
+  ASSERT(fixedpoint_packed_create(SIZE_MAX) == NULL);
+  ASSERT(fixedpoint_packed_create(SIZE_MAX / sizeof(uint64_t) + 1) == NULL);
+}
+
+void test_packed_ops(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointPackedArray *left = fixedpoint_packed_create(n * n);
+  FixedpointPackedArray *right = fixedpoint_packed_create(n * n);
+  FixedpointPackedArray *res = fixedpoint_packed_create(n * n);
+  int8_t *cmp = malloc(n * n);
+
+  // every pair of test values (more than one block of elements)
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      fixedpoint_packed_set(left, i * n + j, objs->all[i]);
+      fixedpoint_packed_set(right, i * n + j, objs->all[j]);
+    }
+  }
+
+  ASSERT(fixedpoint_packed_add(res, left, right, 0, n * n));
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_add(objs->all[k / n], objs->all[k % n]), fixedpoint_packed_get(res, k));
+  }
+  ASSERT(res->num_exceptions > 0);
+  ASSERT(fixedpoint_packed_sub(res, left, right, 0, n * n));
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_sub(objs->all[k / n], objs->all[k % n]), fixedpoint_packed_get(res, k));
+  }
+  ASSERT(fixedpoint_packed_halve(res, left, 0, n * n));
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_halve(objs->all[k / n]), fixedpoint_packed_get(res, k));
+  }
+  ASSERT(fixedpoint_packed_double(res, right, 0, n * n));
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_double(objs->all[k % n]), fixedpoint_packed_get(res, k));
+  }
+  fixedpoint_packed_negate(res, right, 0, n * n);
+  ASSERT(res->num_exceptions == 0);
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_negate(objs->all[k % n]), fixedpoint_packed_get(res, k));
+  }
+  fixedpoint_packed_compare(cmp, left, right, 0, n * n);
+  for (int k = 0; k < n * n; k++) {
+    ASSERT(fixedpoint_compare(objs->all[k / n], objs->all[k % n]) == cmp[k]);
+  }
+
+  // in place, on a sub-range only: the exceptions outside it are kept
+  ASSERT(fixedpoint_packed_add(res, left, left, 0, n * n));
+  ASSERT(fixedpoint_packed_halve(res, res, n, n));
+  for (int k = 0; k < n * n; k++) {
+    Fixedpoint sum = fixedpoint_add(objs->all[k / n], objs->all[k / n]);
+    if (k >= n && k < 2 * n) sum = fixedpoint_halve(sum);
+    CHECK_IDENTICAL(sum, fixedpoint_packed_get(res, k));
+  }
+
+  free(cmp);
+  fixedpoint_packed_destroy(left);
+  fixedpoint_packed_destroy(right);
+  fixedpoint_packed_destroy(res);
+}
+
+void test_array_status(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointArray *left = fixedpoint_array_create(n * n);
+  FixedpointArray *right = fixedpoint_array_create(n * n);
+  FixedpointArray *res = fixedpoint_array_create(n * n);
+  FixedpointStatus status;
+  int first = -1;
+
+  for (int k = 0; k < n * n; k++) {
+    fixedpoint_array_set(left, k, objs->all[k / n]);
+    fixedpoint_array_set(right, k, objs->all[k % n]);
+    if (first < 0 && !fixedpoint_is_valid(fixedpoint_add(objs->all[k / n], objs->all[k % n]))) {
+      first = k;
+    }
+  }
+
+  // the results hold the same magnitudes as the tagged ones, with valid tags
+  fixedpoint_status_clear(&status);
+  fixedpoint_array_add_status(res, left, right, 0, n * n, &status);
+  ASSERT(status.flags == FIXEDPOINT_FLAG_OVERFLOW);
+  ASSERT(status.first_index == (size_t)first);
+  for (int k = 0; k < n * n; k++) {
+    Fixedpoint sum = fixedpoint_add(objs->all[k / n], objs->all[k % n]);
+    Fixedpoint val = fixedpoint_array_get(res, k);
+    ASSERT(fixedpoint_is_valid(val));
+    ASSERT(fixedpoint_is_neg(val) == (fixedpoint_is_neg(sum) || fixedpoint_is_overflow_neg(sum)));
+    ASSERT(val.whole == sum.whole && val.frac == sum.frac);
+  }
+
+  // no flags for a batch without overflow; the flags and the index stick
+  fixedpoint_status_clear(&status);
+  fixedpoint_array_sub_status(res, left, left, 0, n * n, &status);
+  ASSERT(status.flags == 0);
+  ASSERT(status.first_index == FIXEDPOINT_NO_INDEX);
+  fixedpoint_array_double_status(res, right, n, n * n - n, &status);
+  ASSERT(status.flags == FIXEDPOINT_FLAG_OVERFLOW);
+  ASSERT(status.first_index >= (size_t)n);
+  size_t index = status.first_index;
+  fixedpoint_array_set(left, 0, fixedpoint_create2(0UL, 1UL));
+  fixedpoint_array_halve_status(res, left, 0, 1, &status);
+  ASSERT(status.flags == (FIXEDPOINT_FLAG_OVERFLOW | FIXEDPOINT_FLAG_POS_UNDERFLOW));
+  ASSERT(status.first_index == index);
+  ASSERT(fixedpoint_is_zero(fixedpoint_array_get(res, 0)));
+
+  // with a NULL status, the thread's default status is used
+  fixedpoint_status_clear(fixedpoint_status());
+  fixedpoint_array_halve_status(res, left, 0, 1, NULL);
+  ASSERT(fixedpoint_status()->flags == FIXEDPOINT_FLAG_POS_UNDERFLOW);
+  ASSERT(fixedpoint_status()->first_index == 0);
+
+  fixedpoint_array_destroy(left);
+  fixedpoint_array_destroy(right);
+  fixedpoint_array_destroy(res);
+}
+
+// The saturated result expected for a (possibly non-valid) result
+static Fixedpoint saturated(Fixedpoint val) {
+  if (fixedpoint_is_overflow_pos(val)) return fixedpoint_create2(~0UL, ~0UL);
+  if (fixedpoint_is_overflow_neg(val)) return fixedpoint_negate(fixedpoint_create2(~0UL, ~0UL));
+  if (fixedpoint_is_underflow_pos(val) || fixedpoint_is_underflow_neg(val)) {
+    Fixedpoint res = fixedpoint_create2(val.whole, val.frac);
+    return fixedpoint_is_underflow_neg(val) ? fixedpoint_negate(res) : res;
+  }
+  return val;
+}
+
+void test_saturating(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointArray *left = fixedpoint_array_create(n * n);
+  FixedpointArray *right = fixedpoint_array_create(n * n);
+  FixedpointArray *res = fixedpoint_array_create(n * n);
+  Fixedpoint ulp = fixedpoint_create2(0UL, 1UL);
+
+  CHECK_IDENTICAL(objs->max, fixedpoint_add_sat(objs->max, objs->one));
+  CHECK_IDENTICAL(objs->min, fixedpoint_sub_sat(objs->min, objs->one));
+  CHECK_IDENTICAL(objs->min, fixedpoint_double_sat(objs->min));
+  CHECK_IDENTICAL(objs->max, fixedpoint_mul_sat(objs->max, objs->max));
+  CHECK_IDENTICAL(objs->min, fixedpoint_mul_sat(objs->max, objs->min));
+  // underflow truncates toward zero, and a zero result isn't negative
+  CHECK_IDENTICAL(objs->zero, fixedpoint_mul_sat(fixedpoint_negate(ulp), objs->one_half));
+  CHECK_IDENTICAL(fixedpoint_negate(ulp),
+                  fixedpoint_mul_sat(fixedpoint_create2(0UL, 3UL), fixedpoint_negate(objs->one_half)));
+
+  for (int k = 0; k < n * n; k++) {
+    Fixedpoint a = objs->all[k / n], b = objs->all[k % n];
+    CHECK_IDENTICAL(saturated(fixedpoint_add(a, b)), fixedpoint_add_sat(a, b));
+    CHECK_IDENTICAL(saturated(fixedpoint_sub(a, b)), fixedpoint_sub_sat(a, b));
+    CHECK_IDENTICAL(saturated(fixedpoint_mul(a, b)), fixedpoint_mul_sat(a, b));
+    CHECK_IDENTICAL(saturated(fixedpoint_double(a)), fixedpoint_double_sat(a));
+    fixedpoint_array_set(left, k, a);
+    fixedpoint_array_set(right, k, b);
+  }
+
+  fixedpoint_array_add_sat(res, left, right, 0, n * n);
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_add_sat(objs->all[k / n], objs->all[k % n]), fixedpoint_array_get(res, k));
+  }
+  fixedpoint_array_sub_sat(res, left, right, 0, n * n);
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_sub_sat(objs->all[k / n], objs->all[k % n]), fixedpoint_array_get(res, k));
+  }
+  fixedpoint_array_mul_sat(res, left, right, 0, n * n);
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_mul_sat(objs->all[k / n], objs->all[k % n]), fixedpoint_array_get(res, k));
+  }
+  fixedpoint_array_double_sat(res, left, 0, n * n);
+  for (int k = 0; k < n * n; k++) {
+    CHECK_IDENTICAL(fixedpoint_double_sat(objs->all[k / n]), fixedpoint_array_get(res, k));
+  }
+
+  fixedpoint_array_destroy(left);
+  fixedpoint_array_destroy(right);
+  fixedpoint_array_destroy(res);
+}
+
+void test_scale_pow2(TestObjs *objs) {
+  Fixedpoint three_ulp = fixedpoint_create2(0UL, 3UL), five_ulp = fixedpoint_create2(0UL, 5UL);
+  FixedpointArray *arr = fixedpoint_array_create(objs->num_all);
+
+  // the same as repeated halve/double, up to the first non-valid result
+  for (int i = 0; i < objs->num_all; i++) {
+    Fixedpoint halved = objs->all[i], doubled = objs->all[i];
+    for (int k = 1; k <= 8; k++) {
+      if (fixedpoint_is_valid(halved)) {
+        halved = fixedpoint_halve(halved);
+        CHECK_IDENTICAL(halved, fixedpoint_scale_pow2(objs->all[i], -k));
+      }
+      if (fixedpoint_is_valid(doubled)) {
+        doubled = fixedpoint_double(doubled);
+        CHECK_IDENTICAL(doubled, fixedpoint_scale_pow2(objs->all[i], k));
+      }
+    }
+    CHECK_IDENTICAL(objs->all[i], fixedpoint_scale_pow2(objs->all[i], 0));
+  }
+
+  CHECK_IDENTICAL(objs->one, fixedpoint_scale_pow2(objs->one_half, 1));
+  CHECK_IDENTICAL(fixedpoint_create(0x100000000UL), fixedpoint_scale_pow2(objs->one, 32));
+  CHECK_IDENTICAL(fixedpoint_create2(0UL, 1UL), fixedpoint_scale_pow2(objs->one, -64));
+  ASSERT(fixedpoint_is_overflow_pos(fixedpoint_scale_pow2(objs->one, 64)));
+  ASSERT(fixedpoint_is_overflow_neg(fixedpoint_scale_pow2(objs->neg_1, 1000)));
+  ASSERT(fixedpoint_is_underflow_neg(fixedpoint_scale_pow2(objs->neg_1, -65)));
+  ASSERT(fixedpoint_is_underflow_pos(fixedpoint_scale_pow2(objs->max, -2147483647 - 1)));
+  CHECK_IDENTICAL(objs->zero, fixedpoint_scale_pow2(objs->zero, 1000));
+  CHECK_IDENTICAL(objs->zero, fixedpoint_scale_pow2(objs->zero, -1000));
+
+  // rounding modes
+  CHECK_IDENTICAL(fixedpoint_create2(0UL, 1UL),
+                  fixedpoint_scale_pow2_round(three_ulp, -1, FIXEDPOINT_ROUND_TRUNC));
+  CHECK_IDENTICAL(fixedpoint_negate(fixedpoint_create2(0UL, 1UL)),
+                  fixedpoint_scale_pow2_round(fixedpoint_negate(three_ulp), -1, FIXEDPOINT_ROUND_TRUNC));
+  CHECK_IDENTICAL(fixedpoint_create2(0UL, 1UL),
+                  fixedpoint_scale_pow2_round(three_ulp, -1, FIXEDPOINT_ROUND_FLOOR));
+  CHECK_IDENTICAL(fixedpoint_negate(fixedpoint_create2(0UL, 2UL)),
+                  fixedpoint_scale_pow2_round(fixedpoint_negate(three_ulp), -1, FIXEDPOINT_ROUND_FLOOR));
+  CHECK_IDENTICAL(fixedpoint_create2(0UL, 2UL),
+                  fixedpoint_scale_pow2_round(three_ulp, -1, FIXEDPOINT_ROUND_NEAREST_EVEN));
+  CHECK_IDENTICAL(fixedpoint_create2(0UL, 2UL),
+                  fixedpoint_scale_pow2_round(five_ulp, -1, FIXEDPOINT_ROUND_NEAREST_EVEN));
+  CHECK_IDENTICAL(fixedpoint_create2(0UL, 1UL),
+                  fixedpoint_scale_pow2_round(five_ulp, -2, FIXEDPOINT_ROUND_NEAREST_EVEN));
+  CHECK_IDENTICAL(objs->zero,
+                  fixedpoint_scale_pow2_round(fixedpoint_negate(five_ulp), -3, FIXEDPOINT_ROUND_TRUNC));
+  // 2^63 ulp * 2^-128 is below half an ulp, 2^127 ulp + 1 ulp above it
+  CHECK_IDENTICAL(objs->zero,
+                  fixedpoint_scale_pow2_round(fixedpoint_create2(0x8000000000000000UL, 0UL), -128,
+                                              FIXEDPOINT_ROUND_NEAREST_EVEN));
+  CHECK_IDENTICAL(fixedpoint_create2(0UL, 1UL),
+                  fixedpoint_scale_pow2_round(fixedpoint_create2(0x8000000000000000UL, 1UL), -128,
+                                              FIXEDPOINT_ROUND_NEAREST_EVEN));
+  CHECK_IDENTICAL(fixedpoint_negate(fixedpoint_create2(0UL, 1UL)),
+                  fixedpoint_scale_pow2_round(objs->neg_1, -1000, FIXEDPOINT_ROUND_FLOOR));
+  ASSERT(fixedpoint_is_overflow_pos(fixedpoint_scale_pow2_round(objs->max, 1, FIXEDPOINT_ROUND_FLOOR)));
+
+  fixedpoint_array_load(arr, 0, objs->all, objs->num_all);
+  fixedpoint_array_scale_pow2(arr, arr, 0, objs->num_all, -3, FIXEDPOINT_ROUND_NEAREST_EVEN);
+  for (int i = 0; i < objs->num_all; i++) {
+    CHECK_IDENTICAL(fixedpoint_scale_pow2_round(objs->all[i], -3, FIXEDPOINT_ROUND_NEAREST_EVEN),
+                    fixedpoint_array_get(arr, i));
+  }
+  fixedpoint_array_destroy(arr);
+}
+
+void test_sort_key(TestObjs *objs) {
+  uint8_t a[FIXEDPOINT_SORT_KEY_LEN], b[FIXEDPOINT_SORT_KEY_LEN];
+
+  // memcmp order of the keys is the fixedpoint_compare order
+  for (int i = 0; i < objs->num_all; i++) {
+    fixedpoint_sort_key(objs->all[i], a);
+    for (int j = 0; j < objs->num_all; j++) {
+      fixedpoint_sort_key(objs->all[j], b);
+      int cmp = memcmp(a, b, FIXEDPOINT_SORT_KEY_LEN);
+      ASSERT(((cmp > 0) - (cmp < 0)) == fixedpoint_compare(objs->all[i], objs->all[j]));
+    }
+  }
+
+  // a zero with a negative tag has the same key as zero
+  Fixedpoint neg_zero = objs->zero;
+  neg_zero.tag = TAG_VALID_NEGATIVE;
+  fixedpoint_sort_key(objs->zero, a);
+  fixedpoint_sort_key(neg_zero, b);
+  ASSERT(0 == memcmp(a, b, FIXEDPOINT_SORT_KEY_LEN));
+
+  // non-valid values sort after all valid values
+  fixedpoint_sort_key(objs->max, a);
+  fixedpoint_sort_key(fixedpoint_double(fixedpoint_negate(objs->max)), b);
+  ASSERT(memcmp(a, b, FIXEDPOINT_SORT_KEY_LEN) < 0);
+  fixedpoint_sort_key(fixedpoint_create2(0UL, 0x0123456789abcdefUL), a);
+  ASSERT(1 == a[0] && 0 == a[8] && 0x01 == a[9] && 0xef == a[16]);
+}
+
+// Elements of the sort test, ordered by key and then by original index
+typedef struct {
+  uint8_t key[FIXEDPOINT_SORT_KEY_LEN];
+  size_t index;
+} SortEntry;
+
+static int compare_sort_entries(const void *a, const void *b) {
+  const SortEntry *x = a, *y = b;
+  int cmp = memcmp(x->key, y->key, FIXEDPOINT_SORT_KEY_LEN);
+  if (cmp != 0) return cmp;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+void test_array_sort(TestObjs *objs) {
+  // sums and differences of fixture values, some of them overflowing,
+  // plus zeros with a negative tag; large enough to be split between
+  // threads
+  size_t n = 300000;
+  FixedpointArray *arr = fixedpoint_array_create(n + 2);
+  Fixedpoint *vals = malloc(n * sizeof(Fixedpoint));
+  SortEntry *entries = malloc(n * sizeof(SortEntry));
+  uint64_t state = 12345;
+  for (size_t i = 0; i < n; i++) {
+    state = state * 6364136223846793005UL + 1442695040888963407UL;
+    Fixedpoint l = objs->all[(state >> 33) % objs->num_all];
+    Fixedpoint r = objs->all[(state >> 17) % objs->num_all];
+    vals[i] = (state >> 60) ? fixedpoint_add(l, r) : fixedpoint_sub(l, r);
+    if ((state >> 56) == 0) {
+      vals[i] = objs->zero;
+      vals[i].tag = TAG_VALID_NEGATIVE;
+    }
+    fixedpoint_sort_key(vals[i], entries[i].key);
+    entries[i].index = i;
+  }
+  qsort(entries, n, sizeof(SortEntry), compare_sort_entries);
+
+  for (int nthreads = 0; nthreads <= 4; nthreads++) {
+    // the elements around the range must be left alone
+    fixedpoint_array_set(arr, 0, objs->max);
+    fixedpoint_array_set(arr, n + 1, objs->neg_1);
+    fixedpoint_array_load(arr, 1, vals, n);
+    ASSERT(fixedpoint_array_sort(arr, 1, n, nthreads));
+    for (size_t i = 0; i < n; i++) {
+      CHECK_IDENTICAL(vals[entries[i].index], fixedpoint_array_get(arr, 1 + i));
+    }
+    CHECK_IDENTICAL(objs->max, fixedpoint_array_get(arr, 0));
+    CHECK_IDENTICAL(objs->neg_1, fixedpoint_array_get(arr, n + 1));
+  }
+
+  // small and trivial ranges
+  fixedpoint_array_load(arr, 0, objs->all, objs->num_all);
+  ASSERT(fixedpoint_array_sort(arr, 0, objs->num_all, 1));
+  for (int i = 1; i < objs->num_all; i++) {
+    ASSERT(fixedpoint_compare(fixedpoint_array_get(arr, i - 1), fixedpoint_array_get(arr, i)) <= 0);
+  }
+  ASSERT(fixedpoint_array_sort(arr, 0, 1, 1));
+  ASSERT(fixedpoint_array_sort(arr, 0, 0, 1));
+
+  fixedpoint_array_destroy(arr);
+  free(vals);
+  free(entries);
+}
+
+void test_accumulator(TestObjs *objs) {
+  FixedpointAccumulator acc, other;
+
+  // the same as fixedpoint_add for two values, including overflow
+  for (int i = 0; i < objs->num_all; i++) {
+    for (int j = 0; j < objs->num_all; j++) {
+      fixedpoint_accumulator_clear(&acc);
+      fixedpoint_accumulator_add(&acc, objs->all[i]);
+      fixedpoint_accumulator_add(&acc, objs->all[j]);
+      CHECK_IDENTICAL(fixedpoint_add(objs->all[i], objs->all[j]), fixedpoint_accumulator_value(&acc));
+    }
+  }
+
+  // partial sums far outside the range don't matter if the final sum fits
+  fixedpoint_accumulator_clear(&acc);
+  CHECK_IDENTICAL(objs->zero, fixedpoint_accumulator_value(&acc));
+  for (int i = 0; i < 1000; i++) fixedpoint_accumulator_add(&acc, objs->max);
+  fixedpoint_accumulator_add(&acc, objs->one);
+  for (int i = 0; i < 999; i++) fixedpoint_accumulator_add(&acc, objs->min);
+  CHECK_IDENTICAL(fixedpoint_add(objs->max, objs->one), fixedpoint_accumulator_value(&acc));
+  fixedpoint_accumulator_add(&acc, objs->neg_1);
+  CHECK_IDENTICAL(objs->max, fixedpoint_accumulator_value(&acc));
+  for (int i = 0; i < 2; i++) fixedpoint_accumulator_add(&acc, objs->min);
+  CHECK_IDENTICAL(objs->min, fixedpoint_accumulator_value(&acc));
+
+  // merging
+  fixedpoint_accumulator_clear(&other);
+  fixedpoint_accumulator_add(&other, objs->large1);
+  fixedpoint_accumulator_add(&other, objs->max);
+  fixedpoint_accumulator_merge(&acc, &other);
+  CHECK_IDENTICAL(objs->large1, fixedpoint_accumulator_value(&acc));
+
+  // a non-valid value makes the sum an error
+  fixedpoint_accumulator_add(&other, fixedpoint_double(objs->max));
+  ASSERT(fixedpoint_is_err(fixedpoint_accumulator_value(&other)));
+  fixedpoint_accumulator_merge(&acc, &other);
+  ASSERT(fixedpoint_is_err(fixedpoint_accumulator_value(&acc)));
+
+  // arrays: the result doesn't depend on the number of threads
+  size_t n = 300000;
+  FixedpointArray *arr = fixedpoint_array_create(n);
+  uint64_t state = 12345;
+  fixedpoint_accumulator_clear(&acc);
+  for (size_t i = 0; i < n; i++) {
+    state = state * 6364136223846793005UL + 1442695040888963407UL;
+    Fixedpoint val = objs->all[(state >> 33) % objs->num_all];
+    fixedpoint_array_set(arr, i, val);
+    fixedpoint_accumulator_add(&acc, val);
+  }
+  Fixedpoint sum = fixedpoint_accumulator_value(&acc);
+  for (int nthreads = 0; nthreads <= 4; nthreads++) {
+    CHECK_IDENTICAL(sum, fixedpoint_array_sum(arr, 0, n, nthreads));
+  }
+  fixedpoint_accumulator_clear(&acc);
+  fixedpoint_accumulator_add_array(&acc, arr, 5, 2);
+  CHECK_IDENTICAL(fixedpoint_add(fixedpoint_array_get(arr, 5), fixedpoint_array_get(arr, 6)),
+                  fixedpoint_accumulator_value(&acc));
+  CHECK_IDENTICAL(objs->zero, fixedpoint_array_sum(arr, 0, 0, 1));
+  fixedpoint_array_set(arr, n - 1, fixedpoint_double(objs->max));
+  ASSERT(fixedpoint_is_err(fixedpoint_array_sum(arr, 0, n, 3)));
+
+  fixedpoint_array_destroy(arr);
+}
+
+void test_lazy_sum(TestObjs *objs) {
+  FixedpointLazySum sum, other;
+  FixedpointAccumulator acc;
+
+  // the same as fixedpoint_add for two values, including overflow
+  for (int i = 0; i < objs->num_all; i++) {
+    for (int j = 0; j < objs->num_all; j++) {
+      fixedpoint_lazy_sum_clear(&sum);
+      fixedpoint_lazy_sum_add(&sum, objs->all[i]);
+      fixedpoint_lazy_sum_add(&sum, objs->all[j]);
+      CHECK_IDENTICAL(fixedpoint_add(objs->all[i], objs->all[j]), fixedpoint_lazy_sum_value(&sum));
+    }
+  }
+
+  // the same as an accumulator for long sums, with carries and borrows
+  // in both directions
+  fixedpoint_lazy_sum_clear(&sum);
+  fixedpoint_accumulator_clear(&acc);
+  CHECK_IDENTICAL(objs->zero, fixedpoint_lazy_sum_value(&sum));
+  for (int i = 0; i < 1000; i++) {
+    Fixedpoint val = objs->all[(i * 7) % objs->num_all];
+    fixedpoint_lazy_sum_add(&sum, val);
+    fixedpoint_accumulator_add(&acc, val);
+    CHECK_IDENTICAL(fixedpoint_accumulator_value(&acc), fixedpoint_lazy_sum_value(&sum));
+  }
+  for (int i = 0; i < 1000; i++) fixedpoint_lazy_sum_add(&sum, objs->min);
+  for (int i = 0; i < 1000; i++) fixedpoint_lazy_sum_add(&sum, objs->max);
+  CHECK_IDENTICAL(fixedpoint_accumulator_value(&acc), fixedpoint_lazy_sum_value(&sum));
+
+  // merging, and adding to an accumulator
+  fixedpoint_lazy_sum_clear(&other);
+  fixedpoint_lazy_sum_add(&other, objs->neg_one_eighth);
+  fixedpoint_lazy_sum_add(&other, objs->max);
+  fixedpoint_lazy_sum_merge(&sum, &other);
+  fixedpoint_accumulator_add(&acc, objs->neg_one_eighth);
+  fixedpoint_accumulator_add(&acc, objs->max);
+  CHECK_IDENTICAL(fixedpoint_accumulator_value(&acc), fixedpoint_lazy_sum_value(&sum));
+  fixedpoint_accumulator_clear(&acc);
+  fixedpoint_accumulator_add(&acc, objs->one);
+  fixedpoint_accumulator_add_lazy_sum(&acc, &other);
+  CHECK_IDENTICAL(fixedpoint_add(objs->max, fixedpoint_create2(0UL, 0xe000000000000000UL)),
+                  fixedpoint_accumulator_value(&acc));
+
+  // a non-valid value makes the sum an error
+  fixedpoint_lazy_sum_add(&other, fixedpoint_double(objs->max));
+  ASSERT(fixedpoint_is_err(fixedpoint_lazy_sum_value(&other)));
+  fixedpoint_lazy_sum_merge(&sum, &other);
+  ASSERT(fixedpoint_is_err(fixedpoint_lazy_sum_value(&sum)));
+
+  // arrays, including ranges that don't fill every lane
+  int n = objs->num_all;
+  FixedpointArray *arr = fixedpoint_array_create(n);
+  fixedpoint_array_load(arr, 0, objs->all, n);
+  for (int start = 0; start < 4; start++) {
+    for (int len = 0; start + len <= n; len++) {
+      fixedpoint_lazy_sum_clear(&sum);
+      fixedpoint_lazy_sum_add_array(&sum, arr, start, len);
+      fixedpoint_accumulator_clear(&acc);
+      fixedpoint_accumulator_add_array(&acc, arr, start, len);
+      CHECK_IDENTICAL(fixedpoint_accumulator_value(&acc), fixedpoint_lazy_sum_value(&sum));
+    }
+  }
+  fixedpoint_array_destroy(arr);
+}
+
+// Run an add/sub kernel over every pair of test values (plus a few extra
+// elements so that the vector kernels' scalar tail is exercised), checking
+// against fixedpoint_add/fixedpoint_sub
+static void check_addsub_kernel(TestObjs *objs, fp_addsub_kernel kernel) {
+  int n = objs->num_all;
+  int len = n * n + 5;
+  FixedpointArray *left = fixedpoint_array_create(len);
+  FixedpointArray *right = fixedpoint_array_create(len);
+  FixedpointArray *res = fixedpoint_array_create(len);
+
+  for (int i = 0; i < len; i++) {
+    fixedpoint_array_set(left, i, objs->all[(i / n) % n]);
+    fixedpoint_array_set(right, i, objs->all[i % n]);
+  }
+
+  for (unsigned flip = 0; flip <= 1; flip++) {
+    kernel(res->whole, res->frac, res->tag, left->whole, left->frac, left->tag,
+           right->whole, right->frac, right->tag, len, flip);
+    for (int i = 0; i < len; i++) {
+      Fixedpoint l = fixedpoint_array_get(left, i), r = fixedpoint_array_get(right, i);
+      CHECK_IDENTICAL(flip ? fixedpoint_sub(l, r) : fixedpoint_add(l, r),
+                      fixedpoint_array_get(res, i));
+    }
+  }
+
+  // in place
+  kernel(left->whole, left->frac, left->tag, left->whole, left->frac, left->tag,
+         right->whole, right->frac, right->tag, len, 0);
+  for (int i = 0; i < len; i++) {
+    CHECK_IDENTICAL(fixedpoint_add(objs->all[(i / n) % n], objs->all[i % n]),
+                    fixedpoint_array_get(left, i));
+  }
+
+  fixedpoint_array_destroy(left);
+  fixedpoint_array_destroy(right);
+  fixedpoint_array_destroy(res);
+}
+
+void test_addsub_kernels(TestObjs *objs) {
+  check_addsub_kernel(objs, fp_addsub_scalar);
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    check_addsub_kernel(objs, fp_addsub_avx2);
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    check_addsub_kernel(objs, fp_addsub_avx512);
+  }
+#endif
+}
+
+void test_dispatch(TestObjs *objs) {
+  enum FixedpointIsa orig = fixedpoint_isa();
+  enum FixedpointIsa best = fixedpoint_isa_best();
+
+  ASSERT(orig <= best);
+  ASSERT(0 == strcmp("scalar", fixedpoint_isa_name(FIXEDPOINT_ISA_SCALAR)));
+  ASSERT(0 == strcmp("avx512", fixedpoint_isa_name(FIXEDPOINT_ISA_AVX512)));
+  ASSERT(0 == strcmp("unknown", fixedpoint_isa_name((enum FixedpointIsa)42)));
+  ASSERT(0 == fixedpoint_set_isa((enum FixedpointIsa)42));
+  if (best < FIXEDPOINT_ISA_AVX512) {
+    ASSERT(0 == fixedpoint_set_isa((enum FixedpointIsa)(best + 1)));
+    ASSERT(orig == fixedpoint_isa());
+  }
+
+  // every supported level must give the same results
+  for (int isa = FIXEDPOINT_ISA_SCALAR; isa <= (int)best; isa++) {
+    ASSERT(1 == fixedpoint_set_isa((enum FixedpointIsa)isa));
+    ASSERT(isa == (int)fixedpoint_isa());
+    test_mul(objs);
+    test_array_add_sub(objs);
+    test_array_unary(objs);
+    test_array_compare(objs);
+  }
+
+  ASSERT(1 == fixedpoint_set_isa(orig));
+}
+
+void test_load_hex_buffer(TestObjs *objs) {
+  static const char text[] =
+    "f6a5865.00f2\n"
+    "-1\r\n"
+    "\n"
+    "1.3?f\n"
+    "10000000000000000\n"
+    "8 \n"
+    "-ffffffffffffffff.ffffffffffffffff\n"
+    "0.8";
+  FixedpointLoad load;
+
+  ASSERT(0 == fixedpoint_load_hex_buffer(text, sizeof(text) - 1, &load));
+  ASSERT(8 == load.values->len);
+  CHECK_IDENTICAL(fixedpoint_create_from_hex("f6a5865.00f2"), fixedpoint_array_get(load.values, 0));
+  CHECK_IDENTICAL(objs->neg_1, fixedpoint_array_get(load.values, 1));
+  CHECK_IDENTICAL(objs->min, fixedpoint_array_get(load.values, 6));
+  CHECK_IDENTICAL(objs->one_half, fixedpoint_array_get(load.values, 7));
+  for (size_t i = 2; i <= 5; i++) {
+    ASSERT(fixedpoint_is_err(fixedpoint_array_get(load.values, i)));
+  }
+
+  ASSERT(4 == load.num_errors);
+  ASSERT(3 == load.errors[0].line && 0 == load.errors[0].column);
+  ASSERT(4 == load.errors[1].line && 3 == load.errors[1].column);
+  ASSERT(5 == load.errors[2].line && 16 == load.errors[2].column);
+  ASSERT(6 == load.errors[3].line && 1 == load.errors[3].column);
+  fixedpoint_load_free(&load);
+
+  // empty input, and a final line ending doesn't start another line
+  ASSERT(0 == fixedpoint_load_hex_buffer("", 0, &load));
+  ASSERT(0 == load.values->len);
+  ASSERT(0 == load.num_errors);
+  fixedpoint_load_free(&load);
+  ASSERT(0 == fixedpoint_load_hex_buffer("1\n2\n", 4, &load));
+  ASSERT(2 == load.values->len);
+  ASSERT(0 == load.num_errors);
+  fixedpoint_load_free(&load);
+}
+
+void test_load_hex_fd(TestObjs *objs) {
+  (void) objs;
+  static const char text[] = "1\n-0.4\nxyz\nffff";
+  FixedpointLoad load;
+
+  // regular file (memory-mapped)
+  FILE *f = tmpfile();
+  ASSERT(f != NULL);
+  ASSERT(sizeof(text) - 1 == fwrite(text, 1, sizeof(text) - 1, f));
+  fflush(f);
+  ASSERT(0 == fixedpoint_load_hex_fd(fileno(f), &load));
+  fclose(f);
+  ASSERT(4 == load.values->len);
+  CHECK_IDENTICAL(fixedpoint_negate(objs->one_fourth), fixedpoint_array_get(load.values, 1));
+  CHECK_IDENTICAL(fixedpoint_create(0xffffUL), fixedpoint_array_get(load.values, 3));
+  ASSERT(1 == load.num_errors);
+  ASSERT(3 == load.errors[0].line);
+  fixedpoint_load_free(&load);
+
+  // pipe (read into memory)
+  int fds[2];
+  ASSERT(0 == pipe(fds));
+  ASSERT((ssize_t)sizeof(text) - 1 == write(fds[1], text, sizeof(text) - 1));
+  close(fds[1]);
+  ASSERT(0 == fixedpoint_load_hex_fd(fds[0], &load));
+  close(fds[0]);
+  ASSERT(4 == load.values->len);
+  CHECK_IDENTICAL(fixedpoint_create(0xffffUL), fixedpoint_array_get(load.values, 3));
+  ASSERT(1 == load.num_errors);
+  fixedpoint_load_free(&load);
+
+  ASSERT(-1 == fixedpoint_load_hex_file("/nonexistent/values.txt", &load));
+}
+
+void test_load_hex_parallel(TestObjs *objs) {
+  // one line per pair of fixture values, with an error every 7th line
+  int n = objs->num_all;
+  size_t cap = (size_t)n * n * (FIXEDPOINT_HEX_MAX_LEN + 2), len = 0;
+  char *text = malloc(cap);
+  for (int i = 0; i < n * n; i++) {
+    if (i % 7 == 3) {
+      len += sprintf(text + len, "1.2.3\r\n");
+    } else {
+      len += fixedpoint_format_as_hex_into(objs->all[i % n], text + len, cap - len);
+      text[len++] = '\n';
+    }
+  }
+
+  FixedpointLoad expected, load;
+  ASSERT(0 == fixedpoint_load_hex_buffer(text, len, &expected));
+  ASSERT((size_t)(n * n) == expected.values->len);
+
+  // splitting into more parts than lines must give the same result too
+  for (int nthreads = 0; nthreads <= 3 * n * n; nthreads += (nthreads < 8) ? 1 : n * n) {
+    ASSERT(0 == fixedpoint_load_hex_buffer_parallel(text, len, nthreads, &load));
+    ASSERT(expected.values->len == load.values->len);
+    for (size_t i = 0; i < load.values->len; i++) {
+      CHECK_IDENTICAL(fixedpoint_array_get(expected.values, i), fixedpoint_array_get(load.values, i));
+    }
+    ASSERT(expected.num_errors == load.num_errors);
+    for (size_t i = 0; i < load.num_errors; i++) {
+      ASSERT(expected.errors[i].line == load.errors[i].line);
+      ASSERT(expected.errors[i].column == load.errors[i].column);
+    }
+    fixedpoint_load_free(&load);
+  }
+
+  fixedpoint_load_free(&expected);
+  free(text);
+}
+
+// Benchmarks: each call operates on the next fixture value (or pair of
+// values), so that the compiler can't hoist the work out of the loop
+static int bench_index;
+static volatile uint64_t bench_sink;
+
+void bench_add(TestObjs *objs) {
+  int i = bench_index++ % objs->num_all;
+  Fixedpoint sum = fixedpoint_add(objs->all[i], objs->all[(i + 7) % objs->num_all]);
+  bench_sink = sum.whole ^ sum.frac;
+}
+
+void bench_compare(TestObjs *objs) {
+  int i = bench_index++ % objs->num_all;
+  bench_sink = fixedpoint_compare(objs->all[i], objs->all[(i + 7) % objs->num_all]);
+}
+
+void bench_mul(TestObjs *objs) {
+  int i = bench_index++ % objs->num_all;
+  Fixedpoint prod = fixedpoint_mul(objs->all[i], objs->all[(i + 7) % objs->num_all]);
+  bench_sink = prod.whole ^ prod.frac;
+}
+
+void bench_parse_hex(TestObjs *objs) {
+  static const char *const hex[] = {
+    "0", "-1", "0.8", "4b19efcea.000000ec9a1e2418", "-ffffffffffffffff.ffffffffffffffff"
+  };
+  static const size_t len[] = { 1, 2, 3, 26, 34 };
+  (void) objs;
+
+  int i = bench_index++ % 5;
+  Fixedpoint val;
+  ASSERT(len[i] == fixedpoint_parse_hex(hex[i], len[i], &val));
+  bench_sink = val.whole ^ val.frac;
+}
+
+void bench_format_as_hex_into(TestObjs *objs) {
+  char buf[FIXEDPOINT_HEX_MAX_LEN + 1];
+  int i = bench_index++ % objs->num_all;
+  bench_sink = fixedpoint_format_as_hex_into(objs->all[i], buf, sizeof(buf));
+}
+
+// Run on several threads at once: the scalar functions and the batch
+// kernels must give the same results in every thread
+void test_concurrent_ops(TestObjs *objs) {
+  int n = objs->num_all;
+  FixedpointArray *left = fixedpoint_array_create(n * n);
+  FixedpointArray *right = fixedpoint_array_create(n * n);
+  FixedpointArray *res = fixedpoint_array_create(n * n);
+  ASSERT(left && right && res);
+
+  for (int round = 0; round < 20; round++) {
+    // each thread starts at a different pair
+    for (int k = 0; k < n * n; k++) {
+      int i = (k + tctest_thread_index * 37) % (n * n);
+      fixedpoint_array_set(left, k, objs->all[i / n]);
+      fixedpoint_array_set(right, k, objs->all[i % n]);
+    }
+    fixedpoint_array_add(res, left, right, 0, n * n);
+    for (int k = 0; k < n * n; k++) {
+      Fixedpoint l = fixedpoint_array_get(left, k), r = fixedpoint_array_get(right, k);
+      CHECK_IDENTICAL(fixedpoint_add(l, r), fixedpoint_array_get(res, k));
+      if (fixedpoint_is_valid(fixedpoint_sub(r, l))) {
+        CHECK_IDENTICAL(fixedpoint_negate(fixedpoint_sub(r, l)), fixedpoint_sub(l, r));
+      }
+      CHECK_IDENTICAL(fixedpoint_mul(l, r), fixedpoint_mul(r, l));
+    }
+  }
+
+  fixedpoint_array_destroy(left);
+  fixedpoint_array_destroy(right);
+  fixedpoint_array_destroy(res);
+}
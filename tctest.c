@@ -22,8 +22,13 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/wait.h>
 #include "tctest.h"
 
 typedef struct {
@@ -41,11 +46,14 @@ static tctest_signal tctest_signal_list[] = {
 	{ -1, "unknown signal" }
 };
 
-sigjmp_buf tctest_env;
-int tctest_assertion_line;
-int tctest_failures;
-int tctest_num_executed;
+TCTEST_THREAD_LOCAL sigjmp_buf tctest_env;
+TCTEST_THREAD_LOCAL int tctest_assertion_line;
+TCTEST_THREAD_LOCAL int tctest_failures;
+TCTEST_THREAD_LOCAL int tctest_num_executed;
+TCTEST_THREAD_LOCAL int tctest_thread_index;
 const char *tctest_testname_to_execute;
+const char *tctest_benchname_to_execute;
+int tctest_jobs;
 void (*tctest_on_test_executed)(const char *testname, int passed);
 void (*tctest_on_complete)(int num_passed, int num_executed);
 
@@ -138,3 +146,342 @@ void tctest_register_signal_handlers(void) {
 		sigaction(tctest_signal_list[i].signum, &sa, NULL);
 	}
 }
+
+void tctest_init(void) {
+	const char *jobs = getenv("TCTEST_JOBS");
+
+	if (tctest_jobs == 0 && jobs) {
+		tctest_jobs = atoi(jobs);
+	}
+	tctest_register_signal_handlers();
+}
+
+/*
+ * Threads of a TEST_PARALLEL test.  Each one sets up its own jump
+ * target, so that a failed ASSERT (or a signal) only ends that thread.
+ */
+typedef struct {
+	void (*fn)(void *);
+	void *arg;
+	int index;
+	int failed;
+	pthread_t thread;
+} tctest_worker;
+
+static void *tctest_worker_main(void *p) {
+	tctest_worker *w = p;
+
+	tctest_thread_index = w->index;
+	tctest_assertion_line = -1;
+	if (sigsetjmp(tctest_env, 1) == 0) {
+		w->fn(w->arg);
+	} else {
+		w->failed = 1;
+	}
+	return NULL;
+}
+
+int tctest_run_parallel(void (*fn)(void), void *arg, int nthreads) {
+	tctest_worker *workers = calloc(nthreads > 0 ? nthreads : 1, sizeof(tctest_worker));
+	int i, failed = 0;
+
+	if (!workers) {
+		return nthreads;
+	}
+	for (i = 0; i < nthreads; i++) {
+		workers[i].fn = (void (*)(void *))fn;
+		workers[i].arg = arg;
+		workers[i].index = i;
+		if (pthread_create(&workers[i].thread, NULL, tctest_worker_main, &workers[i]) != 0) {
+			/* run it on this thread after the others */
+			workers[i].thread = pthread_self();
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_equal(workers[i].thread, pthread_self())) {
+			/* the worker replaces this thread's jump target */
+			sigjmp_buf saved_env;
+			memcpy(saved_env, tctest_env, sizeof(sigjmp_buf));
+			tctest_worker_main(&workers[i]);
+			memcpy(tctest_env, saved_env, sizeof(sigjmp_buf));
+		} else {
+			pthread_join(workers[i].thread, NULL);
+		}
+		failed += workers[i].failed;
+	}
+	free(workers);
+	tctest_thread_index = 0;
+	return failed;
+}
+
+/*
+ * Parallel mode: one child process per test.  The parent keeps
+ * a slot for each running child; the child's standard output goes
+ * to a temporary file, which the parent copies to its own output
+ * when the child exits.
+ */
+typedef struct {
+	pid_t pid;
+	const char *testname;
+	FILE *out;
+	double start_ns;
+} tctest_child;
+
+typedef struct {
+	const char *testname;
+	double ms;
+} tctest_timing;
+
+static tctest_child *tctest_children;
+static int tctest_num_children;
+static int tctest_is_child;
+static tctest_timing *tctest_timings;
+static int tctest_num_timings, tctest_timings_cap;
+static double tctest_parallel_start_ns;
+
+static double tctest_now_ns(void);
+
+static void tctest_record_timing(const char *testname, double ms) {
+	if (tctest_num_timings == tctest_timings_cap) {
+		int cap = tctest_timings_cap ? tctest_timings_cap * 2 : 64;
+		tctest_timing *timings = realloc(tctest_timings, cap * sizeof(tctest_timing));
+		if (!timings) {
+			return;
+		}
+		tctest_timings = timings;
+		tctest_timings_cap = cap;
+	}
+	tctest_timings[tctest_num_timings].testname = testname;
+	tctest_timings[tctest_num_timings].ms = ms;
+	tctest_num_timings++;
+}
+
+/* wait for one child to exit, and report its result */
+static void tctest_reap_child(void) {
+	int status, i;
+	pid_t pid;
+	char buf[4096];
+	size_t n;
+
+	do {
+		pid = waitpid(-1, &status, 0);
+	} while (pid < 0 && errno == EINTR);
+	if (pid < 0) {
+		return;
+	}
+	for (i = 0; i < tctest_num_children && tctest_children[i].pid != pid; i++) {
+		;
+	}
+	if (i == tctest_num_children) {
+		return; /* not one of ours */
+	}
+
+	tctest_child child = tctest_children[i];
+	tctest_children[i] = tctest_children[--tctest_num_children];
+	tctest_record_timing(child.testname, (tctest_now_ns() - child.start_ns) / 1e6);
+
+	/* copy the child's output */
+	rewind(child.out);
+	while ((n = fread(buf, 1, sizeof(buf), child.out)) > 0) {
+		fwrite(buf, 1, n, stdout);
+	}
+	fclose(child.out);
+
+	int passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	if (WIFSIGNALED(status)) {
+		printf("crashed (signal %d)\n", WTERMSIG(status));
+	} else if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+		printf("exited abnormally\n");
+	}
+	fflush(stdout);
+
+	tctest_num_executed++;
+	if (!passed) {
+		tctest_failures++;
+	}
+	if (tctest_on_test_executed) {
+		tctest_on_test_executed(child.testname, passed);
+	}
+}
+
+int tctest_fork_test(const char *testname) {
+	if (!tctest_children) {
+		tctest_children = malloc(tctest_jobs * sizeof(tctest_child));
+		tctest_parallel_start_ns = tctest_now_ns();
+		if (!tctest_children) {
+			tctest_jobs = 1;
+			return 0; /* run the tests serially */
+		}
+	}
+	while (tctest_num_children >= tctest_jobs) {
+		tctest_reap_child();
+	}
+
+	FILE *out = tmpfile();
+	if (!out) {
+		return 0; /* run this test in this process */
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) {
+		fclose(out);
+		return 0;
+	}
+	if (pid == 0) {
+		/* child: run the test, with output going to the temporary file */
+		dup2(fileno(out), 1);
+		fclose(out);
+		tctest_is_child = 1;
+		tctest_failures = 0; /* counts of the parent's earlier tests */
+		tctest_on_test_executed = NULL; /* the parent reports the result */
+		return 0;
+	}
+
+	tctest_children[tctest_num_children].pid = pid;
+	tctest_children[tctest_num_children].testname = testname;
+	tctest_children[tctest_num_children].out = out;
+	tctest_children[tctest_num_children].start_ns = tctest_now_ns();
+	tctest_num_children++;
+	return 1;
+}
+
+void tctest_test_done(void) {
+	if (tctest_is_child) {
+		fflush(stdout);
+		_exit(tctest_failures > 0);
+	}
+}
+
+static int tctest_compare_timings(const void *a, const void *b) {
+	double x = ((const tctest_timing *)a)->ms, y = ((const tctest_timing *)b)->ms;
+	return (x < y) - (x > y);
+}
+
+void tctest_wait_all(void) {
+	int i;
+
+	if (!tctest_children) {
+		return;
+	}
+	while (tctest_num_children > 0) {
+		tctest_reap_child();
+	}
+
+	/* summary of the wall clock times */
+	qsort(tctest_timings, tctest_num_timings, sizeof(tctest_timing), tctest_compare_timings);
+	printf("%d test(s) in %.1f ms with %d jobs; slowest:",
+	       tctest_num_timings, (tctest_now_ns() - tctest_parallel_start_ns) / 1e6, tctest_jobs);
+	for (i = 0; i < tctest_num_timings && i < 5; i++) {
+		printf(" %s (%.1f ms)", tctest_timings[i].testname, tctest_timings[i].ms);
+	}
+	printf("\n");
+
+	free(tctest_children);
+	free(tctest_timings);
+	tctest_children = NULL;
+	tctest_timings = NULL;
+	tctest_num_timings = tctest_timings_cap = 0;
+}
+
+/*
+ * Benchmark state.  Samples are the time per call (in ns) measured
+ * over one batch of calls.
+ */
+#define TCTEST_BENCH_MIN_SAMPLES 50
+#define TCTEST_BENCH_MAX_SAMPLES 10000
+#define TCTEST_BENCH_CHECK_EVERY 50
+#define TCTEST_BENCH_WARMUP_NS 20000000.0   /* 20 ms */
+#define TCTEST_BENCH_MAX_NS 2000000000.0    /* 2 s */
+#define TCTEST_BENCH_MIN_SAMPLE_NS 10000.0  /* 10 us */
+
+static struct {
+	const char *name;
+	long iters;
+	int warming_up;
+	double begin_ns, start_ns;
+	double last_median;
+	int num_samples;
+	double samples[TCTEST_BENCH_MAX_SAMPLES];
+} tctest_bench;
+
+static double tctest_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int tctest_compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* sorted copy of the samples so far */
+static const double *tctest_bench_sorted(void) {
+	static double sorted[TCTEST_BENCH_MAX_SAMPLES];
+	int n = tctest_bench.num_samples;
+
+	memcpy(sorted, tctest_bench.samples, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), tctest_compare_doubles);
+	return sorted;
+}
+
+void tctest_bench_begin(const char *benchname, long iters) {
+	/* don't compete with tests running in parallel */
+	tctest_wait_all();
+
+	tctest_bench.name = benchname;
+	tctest_bench.iters = (iters > 0) ? iters : 1;
+	tctest_bench.warming_up = 1;
+	tctest_bench.last_median = -1.0;
+	tctest_bench.num_samples = 0;
+	printf("%s...", benchname);
+	fflush(stdout);
+	tctest_bench.begin_ns = tctest_now_ns();
+}
+
+long tctest_bench_next(void) {
+	int n = tctest_bench.num_samples;
+	double elapsed = tctest_now_ns() - tctest_bench.begin_ns;
+
+	if (n == TCTEST_BENCH_MAX_SAMPLES || (n > 0 && elapsed > TCTEST_BENCH_MAX_NS)) {
+		return 0;
+	}
+	/* the median is checked periodically; stop once it changes by less than 1% */
+	if (n >= TCTEST_BENCH_MIN_SAMPLES && n % TCTEST_BENCH_CHECK_EVERY == 0) {
+		double median = tctest_bench_sorted()[n / 2];
+		double change = median - tctest_bench.last_median;
+		if (tctest_bench.last_median > 0.0 && change < 0.01 * median && change > -0.01 * median) {
+			return 0;
+		}
+		tctest_bench.last_median = median;
+	}
+
+	tctest_bench.start_ns = tctest_now_ns();
+	return tctest_bench.iters;
+}
+
+void tctest_bench_record(void) {
+	double end = tctest_now_ns();
+	double elapsed = end - tctest_bench.start_ns;
+
+	if (tctest_bench.warming_up) {
+		/* samples that are too short to time accurately use more calls */
+		if (elapsed < TCTEST_BENCH_MIN_SAMPLE_NS) {
+			tctest_bench.iters *= 2;
+		} else if (end - tctest_bench.begin_ns > TCTEST_BENCH_WARMUP_NS) {
+			tctest_bench.warming_up = 0;
+			tctest_bench.begin_ns = end;
+		}
+		return;
+	}
+	tctest_bench.samples[tctest_bench.num_samples++] = elapsed / tctest_bench.iters;
+}
+
+void tctest_bench_end(void) {
+	const double *sorted = tctest_bench_sorted();
+	int n = tctest_bench.num_samples;
+
+	printf("min %.2f ns, median %.2f ns, p99 %.2f ns (%d samples of %ld calls)\n",
+	       sorted[0], sorted[n / 2], sorted[(int)(0.99 * (n - 1) + 0.5)],
+	       n, tctest_bench.iters);
+}
@@ -34,12 +34,35 @@
 extern "C" {
 #endif
 
-extern sigjmp_buf tctest_env;
-extern int tctest_assertion_line;
-extern int tctest_failures;
-extern int tctest_num_executed;
+/*
+ * The test state is thread-local, so that an ASSERT failing in a
+ * thread started by TEST_PARALLEL jumps back into that thread.
+ */
+#ifdef __cplusplus
+#define TCTEST_THREAD_LOCAL thread_local
+#else
+#define TCTEST_THREAD_LOCAL _Thread_local
+#endif
+
+extern TCTEST_THREAD_LOCAL sigjmp_buf tctest_env;
+extern TCTEST_THREAD_LOCAL int tctest_assertion_line;
+extern TCTEST_THREAD_LOCAL int tctest_failures;
+extern TCTEST_THREAD_LOCAL int tctest_num_executed;
 void tctest_register_signal_handlers(void);
 
+/*
+ * In a test run by TEST_PARALLEL, the index (0 to nthreads-1) of the
+ * thread running the test function; 0 otherwise.
+ */
+extern TCTEST_THREAD_LOCAL int tctest_thread_index;
+
+/*
+ * Run fn(arg) on nthreads threads at once, returning the number of
+ * threads in which an ASSERT failed (or a signal was caught).
+ * Used by TEST_PARALLEL; fn is a test function cast to void (*)(void).
+ */
+int tctest_run_parallel(void (*fn)(void), void *arg, int nthreads);
+
 /*
  * Setting this pointer to a non-null value will cause tctest to
  * only execute the test with the specified name (which must
@@ -48,6 +71,26 @@ void tctest_register_signal_handlers(void);
  */
 extern const char *tctest_testname_to_execute;
 
+/*
+ * Number of tests to run in parallel.  If greater than 1, each test
+ * runs in a child process of its own (so a crash only affects that
+ * test), with at most this many running at once.  Each test's output
+ * is printed when it completes.  If not set by the test driver before
+ * TEST_INIT, the TCTEST_JOBS environment variable is used.
+ */
+extern int tctest_jobs;
+void tctest_init(void);
+int tctest_fork_test(const char *testname);
+void tctest_test_done(void);
+void tctest_wait_all(void);
+
+/*
+ * Benchmarks (see BENCH) are only executed if this pointer is set
+ * to a non-null value: either the empty string, to execute all
+ * benchmarks, or the name of a single benchmark function.
+ */
+extern const char *tctest_benchname_to_execute;
+
 /*
  * If this function pointer is set to a non-null value, it will
  * be called after a test has been executed.  The testname parameter
@@ -66,11 +109,14 @@ extern void (*tctest_on_test_executed)(const char *testname, int passed);
 extern void (*tctest_on_complete)(int num_passed, int num_executed);
 
 #define TEST_INIT() do { \
-	tctest_register_signal_handlers(); \
+	tctest_init(); \
 } while (0)
 
 #define TEST(func) do { \
 	if (!tctest_testname_to_execute || strcmp(tctest_testname_to_execute, #func) == 0) { \
+		if (tctest_jobs > 1 && tctest_fork_test(#func)) { \
+			break; /* running in a child process */ \
+		} \
 		tctest_num_executed++; \
 		tctest_assertion_line = -1; \
 		if (sigsetjmp(tctest_env, 1) == 0) { \
@@ -89,6 +135,84 @@ extern void (*tctest_on_complete)(int num_passed, int num_executed);
 				tctest_on_test_executed(#func, 0); \
 			} \
 		} \
+		tctest_test_done(); \
+	} \
+} while (0)
+
+/*
+ * Benchmark support functions used by the BENCH macro.
+ * tctest_bench_next returns the number of calls to make for the
+ * next sample (0 when done) and starts the clock;
+ * tctest_bench_record stops the clock and records the sample.
+ */
+void tctest_bench_begin(const char *benchname, long iters);
+long tctest_bench_next(void);
+void tctest_bench_record(void);
+void tctest_bench_end(void);
+
+/*
+ * Run a benchmark: func is called with the test fixture repeatedly,
+ * iters times per timed sample (more if that is too short to time
+ * accurately), after a warm-up period, until the median time per
+ * call stabilizes.  The minimum, median, and 99th percentile time
+ * per call are then printed.  A failed ASSERT in func counts as a
+ * test failure.
+ */
+#define BENCH(func, iters) do { \
+	if (tctest_benchname_to_execute && \
+	    (tctest_benchname_to_execute[0] == '\0' || strcmp(tctest_benchname_to_execute, #func) == 0)) { \
+		tctest_assertion_line = -1; \
+		if (sigsetjmp(tctest_env, 1) == 0) { \
+			TestObjs *t = setup(); \
+			long tctest_i, tctest_n; \
+			tctest_bench_begin(#func, (iters)); \
+			while ((tctest_n = tctest_bench_next()) > 0) { \
+				for (tctest_i = 0; tctest_i < tctest_n; tctest_i++) { \
+					func(t); \
+				} \
+				tctest_bench_record(); \
+			} \
+			tctest_bench_end(); \
+			cleanup(t); \
+		} else { \
+			tctest_failures++; \
+		} \
+	} \
+} while (0)
+
+/*
+ * Like TEST, but the test function is run on nthreads threads at once,
+ * all with the same test fixture (so the threads must only read it,
+ * or synchronize).  The test fails if an ASSERT fails in any thread.
+ */
+#define TEST_PARALLEL(func, nthreads) do { \
+	if (!tctest_testname_to_execute || strcmp(tctest_testname_to_execute, #func) == 0) { \
+		if (tctest_jobs > 1 && tctest_fork_test(#func)) { \
+			break; /* running in a child process */ \
+		} \
+		tctest_num_executed++; \
+		tctest_assertion_line = -1; \
+		if (sigsetjmp(tctest_env, 1) == 0) { \
+			TestObjs *t = setup(); \
+			printf("%s...", #func); \
+			fflush(stdout); \
+			int tctest_failed_threads = tctest_run_parallel((void (*)(void))func, t, (nthreads)); \
+			cleanup(t); \
+			if (tctest_failed_threads > 0) { \
+				printf("%s: failed in %d of %d threads\n", #func, tctest_failed_threads, (nthreads)); \
+				siglongjmp(tctest_env, 1); \
+			} \
+			printf("passed!\n"); \
+			if (tctest_on_test_executed) { \
+				tctest_on_test_executed(#func, 1); \
+			} \
+		} else { \
+			tctest_failures++; \
+			if (tctest_on_test_executed) { \
+				tctest_on_test_executed(#func, 0); \
+			} \
+		} \
+		tctest_test_done(); \
 	} \
 } while (0)
 
@@ -111,6 +235,7 @@ extern void (*tctest_on_complete)(int num_passed, int num_executed);
 } while (0)
 
 #define TEST_FINI() do { \
+	tctest_wait_all(); \
 	if (tctest_failures == 0) { \
 		printf("All tests passed!\n"); \
 	} else { \